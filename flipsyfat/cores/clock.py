@@ -6,10 +6,15 @@ class ClockOutput(Module, AutoCSR):
     def __init__(self, pins, width=8):
         self.pins = Array(pins)
         self._div = CSRStorage(width)
+
+        # Stops the clock, as if div were zero, while held high
+        self.stop = Signal()
+
         cnt = Signal(width)
         toggle = Signal()
         self.comb += [p.eq(toggle) for p in self.pins]
-        dv = self._div.storage
+        dv = Signal(width)
+        self.comb += dv.eq(Mux(self.stop, 0, self._div.storage))
         self.sync += [
             If(toggle | ~(dv == 0),
                 If(cnt == 0,
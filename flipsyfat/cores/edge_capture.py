@@ -0,0 +1,51 @@
+from migen import *
+from migen.genlib.cdc import MultiReg
+from migen.genlib.fifo import SyncFIFO
+from misoc.interconnect.csr import *
+
+
+class EdgeCapture(Module, AutoCSR):
+    """Add-on core for timestamping edges on external inputs with the
+       same counter as SDTimer, so they line up with the SD emulator's
+       events without a scope.
+
+       Pins are synchronized, then any enabled edge queues one entry: the
+       timestamp, which pins had an enabled edge, and the level of every
+       pin after it. The CPU reads the oldest entry while 'readable' is set
+       and writes 'pop' to move on. Edges that find the FIFO full are
+       counted in 'dropped' and lost.
+
+       The timestamps lag the pins by the synchronizer's two cycles.
+       """
+    def __init__(self, pins, timer, depth=64):
+        n = len(pins)
+        self._rise = CSRStorage(n)
+        self._fall = CSRStorage(n)
+        self._level = CSRStatus(n)
+        self._readable = CSRStatus()
+        self._ts = CSRStatus(len(timer))
+        self._edges = CSRStatus(n)
+        self._after = CSRStatus(n)
+        self._pop = CSR()
+        self._dropped = CSRStatus(32)
+
+        level = Signal(n)
+        level_prev = Signal(n)
+        self.specials += MultiReg(pins, level)
+        self.sync += level_prev.eq(level)
+        self.comb += self._level.status.eq(level)
+
+        edges = Signal(n)
+        self.comb += edges.eq((level & ~level_prev & self._rise.storage) |
+                              (~level & level_prev & self._fall.storage))
+
+        self.submodules.fifo = fifo = SyncFIFO(len(timer) + 2*n, depth)
+        self.comb += [
+            fifo.din.eq(Cat(timer, edges, level)),
+            fifo.we.eq(edges != 0),
+            fifo.re.eq(self._pop.re),
+            self._readable.status.eq(fifo.readable),
+            Cat(self._ts.status, self._edges.status, self._after.status).eq(fifo.dout),
+        ]
+        self.sync += If(fifo.we & ~fifo.writable,
+            self._dropped.status.eq(self._dropped.status + 1))
@@ -0,0 +1,28 @@
+from migen import *
+from migen.genlib.cdc import MultiReg
+from misoc.interconnect.csr import *
+
+
+class GPIOTristate(Module, AutoCSR):
+    """Same registers as misoc's GPIOTristate, plus a port other cores can
+       use to take over individual pins from the CPU.
+       """
+    def __init__(self, signals):
+        l = len(signals)
+        self._in = CSRStatus(l)
+        self._out = CSRStorage(l)
+        self._oe = CSRStorage(l)
+
+        # Pins with an 'override' bit set follow override_o/override_oe
+        self.override = Signal(l)
+        self.override_o = Signal(l)
+        self.override_oe = Signal(l)
+
+        for n in range(l):
+            t = TSTriple()
+            self.specials += t.get_tristate(signals[n])
+            self.comb += [
+                t.oe.eq(Mux(self.override[n], self.override_oe[n], self._oe.storage[n])),
+                t.o.eq(Mux(self.override[n], self.override_o[n], self._out.storage[n])),
+            ]
+            self.specials += MultiReg(t.i, self._in.status[n])
@@ -0,0 +1,66 @@
+from migen import *
+from misoc.interconnect.csr import *
+
+
+class ResetSequencer(Module, AutoCSR):
+    """Add-on core that resets the victim without the CPU timing it:
+       hold the SD emulator in reset, pull the victim's reset line low
+       and stop its clock for 'low_len' cycles, then release everything
+       and wait 'high_len' more before timestamping the end.
+
+       A sequence starts on a write to 'start', or by itself once the
+       victim finishes reading block 'auto_lba' while 'auto' is set.
+       """
+    def __init__(self, sd_emulator, gpio, clkout, timer, gpio_mask=1, width=32):
+        self._start = CSR()
+        self._low_len = CSRStorage(width)
+        self._high_len = CSRStorage(width)
+        self._auto = CSRStorage()
+        self._auto_lba = CSRStorage(32)
+        self._busy = CSRStatus()
+        self._count = CSRStatus(32)
+        self._ts = CSRStatus(len(timer))
+
+        ll = sd_emulator.ll
+        holding = Signal()
+        self.comb += [
+            sd_emulator.hold_reset.eq(holding),
+            clkout.stop.eq(holding),
+            gpio.override.eq(Replicate(holding, len(gpio.override)) & gpio_mask),
+            gpio.override_o.eq(0),
+            gpio.override_oe.eq(gpio_mask),
+        ]
+
+        # Block finished going out, sampled like SDTimer's events
+        done_prev = Signal()
+        auto_go = Signal()
+        self.sync += done_prev.eq(ll.data_out_done)
+        self.comb += auto_go.eq(self._auto.storage & ll.data_out_done & ~done_prev &
+            (ll.block_read_addr == self._auto_lba.storage))
+
+        remaining = Signal(width)
+        self.submodules.fsm = fsm = FSM()
+        fsm.act("IDLE",
+            If(self._start.re | auto_go,
+                NextValue(remaining, self._low_len.storage),
+                NextState("LOW")
+            )
+        )
+        fsm.act("LOW",
+            holding.eq(1),
+            self._busy.status.eq(1),
+            NextValue(remaining, remaining - 1),
+            If(remaining == 0,
+                NextValue(remaining, self._high_len.storage),
+                NextState("HIGH")
+            )
+        )
+        fsm.act("HIGH",
+            self._busy.status.eq(1),
+            NextValue(remaining, remaining - 1),
+            If(remaining == 0,
+                NextValue(self._ts.status, timer),
+                NextValue(self._count.status, self._count.status + 1),
+                NextState("IDLE")
+            )
+        )
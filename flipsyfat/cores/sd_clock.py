@@ -0,0 +1,142 @@
+from migen import *
+from migen.genlib.cdc import MultiReg, GrayCounter
+from misoc.interconnect.csr import *
+from migen.fhdl.decorators import ClockDomainsRenamer
+
+
+class SDClockMonitor(Module, AutoCSR):
+    """Add-on core measuring the host's SD clock against the system clock.
+
+       A gray-coded count of SD clock edges crosses into the system domain,
+       where every 'window' system cycles the core publishes the number of
+       edges seen (the frequency) and the shortest and longest time between
+       two of them (the jitter, to a system cycle). The SD clock runs slower
+       than the system clock, so the synchronized count moves by at most one
+       per cycle.
+
+       Only full windows count towards speed changes: ones with edges in
+       them, no period saturated and none more than four times the
+       shortest. A window the clock stopped or changed speed in, like
+       those around a reset, is published but otherwise ignored.
+
+       A full window whose edge count differs from the reference by more
+       than the reference shifted right by 'tolerance' starts a candidate.
+       Once 'stable' full windows in a row agree with the candidate, to
+       the same tolerance, it becomes the new reference: the core counts
+       the change and timestamps it with the candidate's first window.
+       Anything else in between drops the candidate. The first speed is a
+       change like any other.
+       """
+    def __init__(self, sd_linklayer, timer, width=32, period_width=16, count_width=8):
+        self._window = CSRStorage(width, reset=1 << 16)
+        self._tolerance = CSRStorage(bits_for(width), reset=6)
+        self._stable = CSRStorage(8, reset=4)
+        self._edges = CSRStatus(width)
+        self._period_min = CSRStatus(period_width)
+        self._period_max = CSRStatus(period_width)
+        self._windows = CSRStatus(32)
+        self._change_edges = CSRStatus(width)
+        self._change_ts = CSRStatus(len(timer))
+        self._change_count = CSRStatus(32)
+
+        self.clock_domains.cd_sd = ClockDomain(reset_less=True)
+        self.comb += self.cd_sd.clk.eq(sd_linklayer.cd_sd.clk)
+
+        gray = ClockDomainsRenamer("sd")(GrayCounter(count_width))
+        self.submodules += gray
+        self.comb += gray.ce.eq(1)
+
+        gray_sys = Signal(count_width)
+        self.specials += MultiReg(gray.q, gray_sys)
+        count = Signal(count_width)
+        count_prev = Signal(count_width)
+        self.comb += count[-1].eq(gray_sys[-1])
+        self.comb += [count[i].eq(count[i + 1] ^ gray_sys[i]) for i in range(count_width - 1)]
+        tick = Signal()
+        self.sync += count_prev.eq(count)
+        self.comb += tick.eq(count != count_prev)
+
+        # Time since the last edge, saturating; a stopped clock reads as
+        # the longest period there is
+        max_period = 2**period_width - 1
+        period = Signal(period_width)
+        seen = Signal()
+        edges = Signal(width)
+        period_min = Signal(period_width, reset=max_period)
+        period_max = Signal(period_width)
+
+        remaining = Signal(width, reset=self._window.storage.reset.value - 1)
+        window_end = Signal()
+        self.comb += window_end.eq(remaining == 0)
+
+        period_max_end = Signal(period_width)
+        full = Signal()
+        self.comb += [
+            period_max_end.eq(Mux(period > period_max, period, period_max)),
+            full.eq((period_min != max_period) & (period_max_end != max_period) &
+                (period_max_end <= (period_min << 2)))
+        ]
+
+        reference = Signal(width)
+        have_reference = Signal()
+        candidate = Signal(width)
+        candidate_ts = Signal(len(timer))
+        run = Signal(8)
+
+        def differs(a, b):
+            return Mux(a > b, a - b, b - a) > (b >> self._tolerance.storage)
+
+        # A full window at a speed other than the reference's, and how many
+        # in a row now agree on it, this one included
+        new_speed = Signal()
+        fresh = Signal()
+        agreed = Signal(8)
+        self.comb += [
+            new_speed.eq(full & (~have_reference | differs(edges, reference))),
+            fresh.eq((run == 0) | differs(edges, candidate)),
+            agreed.eq(Mux(fresh, 1, run + 1))
+        ]
+
+        self.sync += [
+            If(tick,
+                period.eq(1),
+                seen.eq(1)
+            ).Elif(period != max_period,
+                period.eq(period + 1)
+            ),
+
+            If(window_end,
+                remaining.eq(self._window.storage - 1),
+                edges.eq(tick),
+                period_min.eq(max_period),
+                period_max.eq(0),
+                self._edges.status.eq(edges),
+                self._period_min.status.eq(period_min),
+                self._period_max.status.eq(period_max_end),
+                self._windows.status.eq(self._windows.status + 1),
+                If(~new_speed,
+                    run.eq(0)
+                ).Elif(agreed >= self._stable.storage,
+                    reference.eq(edges),
+                    have_reference.eq(1),
+                    run.eq(0),
+                    self._change_edges.status.eq(edges),
+                    self._change_ts.status.eq(Mux(fresh, timer, candidate_ts)),
+                    self._change_count.status.eq(self._change_count.status + 1)
+                ).Else(
+                    If(fresh,
+                        candidate.eq(edges),
+                        candidate_ts.eq(timer)
+                    ),
+                    run.eq(agreed)
+                )
+            ).Else(
+                remaining.eq(remaining - 1),
+                edges.eq(edges + tick),
+                # The first edge ends a gap of unknown length
+                If(tick & seen,
+                    If(period < period_min, period_min.eq(period)),
+                    If(period > period_max, period_max.eq(period))
+                )
+            )
+        ]
@@ -1,4 +1,5 @@
 from flipsyfat.cores.sd_emulator.linklayer import SDLinkLayer
+from flipsyfat.cores.sd_emulator.synth import SDSynth
 
 from migen import *
 from misoc.interconnect.csr import *
@@ -10,8 +11,9 @@ class SDEmulator(Module, AutoCSR):
        with reads and writes backed by software. 
        """
 
-    # Read and write buffers, each a single 512 byte block
-    mem_size = 1024
+    # Two 512 byte read buffers, one write buffer, then the block
+    # synthesizer's templates at 0x600
+    mem_size = 2048
 
     def _connect_event(self, ev, act, done):
         # Event triggered on 'act' positive edge, pulses 'done' on clear
@@ -20,32 +22,109 @@ class SDEmulator(Module, AutoCSR):
         self.comb += ev.trigger.eq(act & ~prev_act)
         self.comb += done.eq(ev.clear)
 
-    def __init__(self, platform, pads, **kwargs):
+    def __init__(self, platform, pads, synth=True, **kwargs):
         self.submodules.ll = ClockDomainsRenamer("local")(SDLinkLayer(platform, pads, **kwargs))
 
+        # Optional hardware generator for root directory and FAT blocks
+        if synth:
+            self.submodules.synth = ClockDomainsRenamer("local")(SDSynth(self.ll))
+        else:
+            self.synth = None
+
         # Event interrupts and acknowledgment
         self.submodules.ev = EventManager()
         self.ev.read = EventSourcePulse()
         self.ev.write = EventSourcePulse()
+        self.ev.free = EventSourcePulse()
+        self.ev.erase = EventSourcePulse()
         self.ev.finalize()
-        self._connect_event(self.ev.read, self.ll.block_read_act, self.ll.block_read_go)
+        read_miss = Signal()
+        read_ack = Signal()
+        self._connect_event(self.ev.read, read_miss, read_ack)
         self._connect_event(self.ev.write, self.ll.block_write_act, self.ll.block_write_done)
 
+        # The link layer handles CMD38 by itself, so watch for it going by.
+        # erase_start/end are already latched from CMD32/33 at that point,
+        # and the link only parses the command the cycle after latching it,
+        # so the erase state still says whether the sequence was valid; one
+        # the card rejects with ERASE_SEQ_ERROR raises nothing. Nothing waits
+        # on the acknowledgment.
+        self._connect_event(self.ev.erase,
+            (self.ll.cmd_in_cmd == 38) & (self.ll.erase_state == 2) &
+            ((self.ll.card_state == 4) | self.ll.mode_spi),     # CARD_TRAN
+            Signal())
+
         # Wishbone access to SRAM buffers
         self.bus = wishbone.Interface()
         self.submodules.wb_rd_buffer = wishbone.SRAM(self.ll.rd_buffer, read_only=False)
         self.submodules.wb_wr_buffer = wishbone.SRAM(self.ll.wr_buffer, read_only=False)
         wb_slaves = [
-            (lambda a: a[9] == 0, self.wb_rd_buffer.bus),
-            (lambda a: a[9] == 1, self.wb_wr_buffer.bus)
+            (lambda a: a[8] == 0, self.wb_rd_buffer.bus),
+            (lambda a: a[7:9] == 2, self.wb_wr_buffer.bus)
         ]
+        if synth:
+            self.submodules.wb_synth_template = wishbone.SRAM(self.synth.template, read_only=False)
+            wb_slaves.append((lambda a: a[7:9] == 3, self.wb_synth_template.bus))
         self.submodules.wb_decoder = wishbone.Decoder(self.bus, wb_slaves, register=True)
 
-        # Local reset domain
+        # Local reset domain, also held by the victim reset sequencer
         self._reset = CSRStorage()
+        self.hold_reset = Signal()
         self.clock_domains.cd_local = ClockDomain()
         self.comb += self.cd_local.clk.eq(ClockSignal())
-        self.comb += self.cd_local.rst.eq(ResetSignal() | self._reset.storage)
+        self.comb += self.cd_local.rst.eq(ResetSignal() | self._reset.storage | self.hold_reset)
+
+        # Ping-pong read buffers. The link layer transmits from the active
+        # bank while firmware fills the other one with the block it expects
+        # next. A read request that matches the prefetched block swaps banks
+        # and proceeds without waiting for the CPU; anything else is a miss,
+        # handled by the read event as before. Blocks the synthesizer
+        # generates go ahead the same way, from neither bank, and win
+        # over a prefetch of the same block. A stop command, any write, or
+        # a read of some other block drops the prefetch, so it can't go
+        # stale behind the host's back. (block_read_stop is no use here,
+        # the link layer raises it at the end of every block.)
+        self._read_bank = CSRStatus()
+        self._prefetch_hint = CSRStatus(32)
+        self._prefetch_addr = CSRStorage(32)
+        self._prefetch_commit = CSR()
+        bank = Signal()
+        prefetch_valid = Signal()
+        prefetch_hit = Signal()
+        synth_hit = Signal()
+        read_go = Signal()
+        prev_go = Signal()
+        if synth:
+            self.comb += [
+                synth_hit.eq(self.synth.hit),
+                self.synth.go.eq(read_go),
+            ]
+        self.comb += [
+            prefetch_hit.eq(self.ll.block_read_act & prefetch_valid & ~synth_hit &
+                (self._prefetch_addr.storage == self.ll.block_read_addr)),
+            read_miss.eq(self.ll.block_read_act & ~prefetch_hit & ~synth_hit),
+            read_go.eq(prefetch_hit | synth_hit | (read_ack & self.ll.block_read_act)),
+            self.ll.block_read_go.eq(read_go),
+            self.ll.rd_bank.eq(bank),
+            self.ll.rd_bank_swap.eq(prefetch_hit),
+            self._read_bank.status.eq(bank),
+            # Once a multi-block read is under way, the idle bank is free
+            # for the next block as soon as the current one is released.
+            self.ev.free.trigger.eq(read_go & ~prev_go & (self.ll.block_read_num != 1)),
+        ]
+        self.sync.local += [
+            prev_go.eq(read_go),
+            If(read_go,
+                prefetch_valid.eq(0),
+                self._prefetch_hint.status.eq(self.ll.block_read_addr + 1)
+            ),
+            If(prefetch_hit, bank.eq(~bank)),
+            If(self._prefetch_commit.re, prefetch_valid.eq(1)),
+            If((self.ll.cmd_in_cmd == 12) | self.ll.block_write_act |
+                (self.ll.block_read_act & (self._prefetch_addr.storage != self.ll.block_read_addr)),
+                prefetch_valid.eq(0)
+            ),
+        ]
 
         # Current data operation
         self._read_act = CSRStatus()
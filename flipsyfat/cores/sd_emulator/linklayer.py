@@ -1,5 +1,6 @@
 import os
 from migen import *
+from migen.genlib.cdc import MultiReg
 
 class SDLinkLayer(Module):
     """This is a Migen wrapper around the lower-level parts of the SD card emulator
@@ -8,8 +9,13 @@ class SDLinkLayer(Module):
        for single 512 byte blocks.
        """
     block_size = 512
-   
-    def  __init__(self, platform, pads, enable_hs=True):
+    rd_banks = 2
+
+    # Card size from sd_params.vh, used unless card_blocks overrides it.
+    # It is both the CSD capacity and the limit on block addresses.
+    default_card_blocks = (249 + 1)*1024
+
+    def  __init__(self, platform, pads, enable_hs=True, card_blocks=None):
         self.pads = pads        
 
         # Verilog sources from ProjectVault ORP
@@ -37,11 +43,27 @@ class SDLinkLayer(Module):
         self.comb += self.cd_sd.clk.eq(pads.clk)
         platform.add_period_constraint(pads.clk, (40.0, 19.2)[enable_hs])
 
-        self.specials.rd_buffer = Memory(32, self.block_size//4)
+        self.specials.rd_buffer = Memory(32, self.rd_banks*self.block_size//4)
         self.specials.wr_buffer = Memory(32, self.block_size//4)
         self.specials.internal_rd_port = self.rd_buffer.get_port(clock_domain="sd")
         self.specials.internal_wr_port = self.wr_buffer.get_port(write_capable=True, clock_domain="sd")
 
+        # Read bank selection. The bank only changes while the PHY is idle,
+        # long before it starts fetching the next block.
+        self.rd_bank = Signal()
+        self.rd_bank_swap = Signal()
+        sd_rd_bank = Signal()
+        self.phy_rd_addr = Signal(7)
+        self.specials += MultiReg(self.rd_bank, sd_rd_bank, odomain="sd")
+        self.comb += self.internal_rd_port.adr.eq(Cat(self.phy_rd_addr, sd_rd_bank))
+
+        # Generated data in place of the read buffer (SD clock domain),
+        # with the same one-clock latency from phy_rd_addr
+        self.rd_synth = Signal()
+        self.rd_synth_data = Signal(32)
+        phy_rd_q = Signal(32)
+        self.comb += phy_rd_q.eq(Mux(self.rd_synth, self.rd_synth_data, self.internal_rd_port.dat_r))
+
         # Communication between PHY and Link layers
         self.card_state = Signal(4)
         self.mode_4bit = Signal()
@@ -103,6 +125,7 @@ class SDLinkLayer(Module):
         self.block_preerase_num = Signal(23)
         self.block_erase_start = Signal(32)
         self.block_erase_end = Signal(32)
+        self.erase_state = Signal(3)        # 2 once CMD32 and CMD33 came in order
 
         # I/O completion inputs
         self.block_read_go = Signal()
@@ -144,8 +167,8 @@ class SDLinkLayer(Module):
             i_data_out_act = self.data_out_act,
             i_data_out_stop = self.data_out_stop,
             o_data_out_done = self.data_out_done,
-            o_bram_rd_sd_addr = self.internal_rd_port.adr,
-            i_bram_rd_sd_q = self.internal_rd_port.dat_r,
+            o_bram_rd_sd_addr = self.phy_rd_addr,
+            i_bram_rd_sd_q = phy_rd_q,
             o_bram_wr_sd_addr = self.internal_wr_port.adr,
             o_bram_wr_sd_wren = self.internal_wr_port.we,
             o_bram_wr_sd_data = self.internal_wr_port.dat_w,
@@ -157,7 +180,16 @@ class SDLinkLayer(Module):
             o_spi_cnt = self.phy_spi_cnt
         )
 
+        # CSD capacity is (C_SIZE+1) * 512 kB
+        params = {}
+        if card_blocks is not None:
+            if card_blocks % 1024 or not 0 < card_blocks <= 0x10000*1024:
+                raise ValueError("card_blocks must be a multiple of 1024, from 512 kB to 32 GB (SDHC)")
+            params["p_CSD_C_SIZE"] = card_blocks//1024 - 1
+        self.card_blocks = card_blocks or self.default_card_blocks
+
         self.specials += Instance("sd_link",
+            **params,
             i_clk_50 = ClockSignal(),
             i_reset_n = ~ResetSignal(),
             o_link_card_state = self.card_state,
@@ -200,6 +232,7 @@ class SDLinkLayer(Module):
             o_block_preerase_num = self.block_preerase_num,
             o_block_erase_start = self.block_erase_start,
             o_block_erase_end = self.block_erase_end,
+            o_link_erase_state = self.erase_state,
             i_opt_enable_hs = Constant(enable_hs),
             o_cmd_in_last = self.cmd_in_last,
             o_info_card_desel = self.info_card_desel,
@@ -0,0 +1,144 @@
+from migen import *
+from migen.genlib.cdc import MultiReg
+from misoc.interconnect.csr import *
+
+
+class SDSynth(Module, AutoCSR):
+    """Generates root directory and FAT16 table blocks in hardware, so
+       reads of them go ahead without waiting for the CPU.
+
+       Root directory blocks are one 32-byte dentry template repeated,
+       with the volume label template in the first entry of the first
+       block. FAT blocks follow the same chaining rules as software's
+       fat_table_entry(): cluster 0 and 1 markers, one contiguous chain,
+       runs of 0x100 clusters below the cluster limit, zero above it.
+
+       Firmware writes the templates and registers while the host isn't
+       reading; they cross into the SD clock domain unsynchronized as a
+       group, like the read bank selection.
+       """
+
+    # Dentry template, then volume label; 8 words each
+    template_words = 16
+
+    # Templates are mapped on the emulator's wishbone bus, not the CSR bus
+    autocsr_exclude = {"template"}
+
+    def __init__(self, sd_linklayer):
+        ll = sd_linklayer
+
+        self._enable = CSRStorage(2)            # Bit 0 root directory, bit 1 FAT
+        self._root_start = CSRStorage(32)
+        self._root_end = CSRStorage(32)         # Inclusive
+        self._fat_start = CSRStorage(32)
+        self._fat_sectors = CSRStorage(16)      # Per table; two tables follow fat_start
+        self._fat_media = CSRStorage(16)        # Cluster 0 entry
+        self._chain_first = CSRStorage(16)
+        self._chain_last = CSRStorage(16)
+        self._cluster_limit = CSRStorage(17)    # Cluster count + 2
+        self._trig_root = CSRStorage(8)
+        self._trig_fat = CSRStorage(8)
+        self._count = CSRStatus(32)
+
+        self.specials.template = Memory(32, self.template_words)
+
+        # Interface to the emulator: 'hit' while the requested block is
+        # one of ours, 'go' when the emulator releases a read to the PHY.
+        # 'trigger' is the SDTrigger latch value for the block being hit.
+        self.hit = Signal()
+        self.go = Signal()
+        self.trigger = Signal(8)
+
+        lba = ll.block_read_addr
+        fat_offset = Signal(32)
+        root_hit = Signal()
+        fat_hit = Signal()
+        fat_sector = Signal(16)
+        self.comb += [
+            # Below fat_start the offset wraps, far out of range
+            fat_offset.eq(lba - self._fat_start.storage),
+            root_hit.eq(self._enable.storage[0] &
+                (lba >= self._root_start.storage) & (lba <= self._root_end.storage)),
+            fat_hit.eq(self._enable.storage[1] & (fat_offset < 2*self._fat_sectors.storage)),
+            fat_sector.eq(Mux(fat_offset < self._fat_sectors.storage,
+                fat_offset, fat_offset - self._fat_sectors.storage)),
+            self.hit.eq(ll.block_read_act & (root_hit | fat_hit)),
+            self.trigger.eq(Mux(fat_hit, self._trig_fat.storage, self._trig_root.storage)),
+        ]
+
+        # What the block being transmitted is, held until the next read
+        active = Signal()
+        label = Signal()
+        table = Signal()
+        base = Signal(16)
+        prev_go = Signal()
+        self.sync += [
+            prev_go.eq(self.go),
+            If(self.go,
+                active.eq(self.hit),
+                label.eq(lba == self._root_start.storage),
+                table.eq(fat_hit),
+                base.eq(fat_sector),
+            ),
+            If(self.go & ~prev_go & self.hit,
+                self._count.status.eq(self._count.status + 1)
+            ),
+        ]
+
+        # Word generation, in the SD clock domain
+        self.clock_domains.cd_sd = ClockDomain(reset_less=True)
+        self.comb += self.cd_sd.clk.eq(ll.cd_sd.clk)
+
+        sd_active = Signal()
+        sd_label = Signal()
+        sd_table = Signal()
+        sd_base = Signal(16)
+        sd_media = Signal(16)
+        sd_chain_first = Signal(16)
+        sd_chain_last = Signal(16)
+        sd_cluster_limit = Signal(17)
+        for i, o in [
+                (active, sd_active),
+                (label, sd_label),
+                (table, sd_table),
+                (base, sd_base),
+                (self._fat_media.storage, sd_media),
+                (self._chain_first.storage, sd_chain_first),
+                (self._chain_last.storage, sd_chain_last),
+                (self._cluster_limit.storage, sd_cluster_limit)]:
+            self.specials += MultiReg(i, o, odomain="sd")
+
+        # Same one-clock latency as the block RAM it stands in for
+        word = ll.phy_rd_addr
+        self.specials.template_port = self.template.get_port(clock_domain="sd")
+        self.comb += self.template_port.adr.eq(Cat(word[0:3], sd_label & (word[3:] == 0)))
+
+        # Word 'w' of FAT sector 's' holds clusters s*0x100 + 2w and the one after
+        cluster = [Signal(24) for n in range(2)]
+        entry = [Signal(16) for n in range(2)]
+        self.comb += [
+            cluster[0].eq(Cat(Constant(0, 1), word, sd_base)),
+            cluster[1].eq(Cat(Constant(1, 1), word, sd_base)),
+        ]
+        for c, e in zip(cluster, entry):
+            self.comb += \
+                If(c == 0,
+                    e.eq(sd_media)
+                ).Elif(c == 1,
+                    e.eq(0xffff)
+                ).Elif((c >= sd_chain_first) & (c <= sd_chain_last),
+                    e.eq(Mux(c == sd_chain_last, 0xffff, c + 1))
+                ).Elif(c < sd_cluster_limit,
+                    e.eq(Mux(c[0:8] == 0xff, 0xffff, c + 1))
+                ).Else(
+                    e.eq(0)
+                )
+
+        # Entries are little-endian; the first byte out is the word's MSB
+        table_word = Signal(32)
+        self.sync.sd += table_word.eq(Cat(entry[1][8:16], entry[1][0:8], entry[0][8:16], entry[0][0:8]))
+
+        self.comb += [
+            ll.rd_synth.eq(sd_active),
+            ll.rd_synth_data.eq(Mux(sd_table, table_word, self.template_port.dat_r)),
+        ]
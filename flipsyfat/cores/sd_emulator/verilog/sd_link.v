@@ -66,6 +66,7 @@ module sd_link (
 
    output reg  [31:0]  block_erase_start,
    output reg  [31:0]  block_erase_end,
+   output wire [2:0]   link_erase_state,
 
    input  wire         opt_enable_hs,
 
@@ -101,6 +102,7 @@ reg  [3:0]   card_state;
 assign       link_card_state = card_state;
 reg  [3:0]   card_state_next;
 reg  [2:0]   card_erase_state;
+assign       link_erase_state = card_erase_state;
 reg          card_appcmd;
 reg  [127:0] card_sd_status;
 reg  [127:0] card_csd;
@@ -22,12 +22,29 @@ class SDTrigger(Module, AutoCSR):
        the SDEmulator's data output completion.
         """
 
-    def __init__(self, sd_linklayer, pins):
-        self._latch = CSRStorage(len(pins))
+    def __init__(self, sd_linklayer, pins, synth=None):
+        self._latch = CSRStorage(len(pins), write_from_dev=True)
+
+        # Latch value for a prefetched read block, loaded when the
+        # emulator switches to the buffer holding that block. Blocks
+        # from the SDEmulator's synthesizer bring their own value.
+        self._latch_next = CSRStorage(len(pins))
+        if synth is None:
+            self.comb += [
+                self._latch.dat_w.eq(self._latch_next.storage),
+                self._latch.we.eq(sd_linklayer.rd_bank_swap),
+            ]
+        else:
+            self.comb += [
+                self._latch.dat_w.eq(Mux(synth.hit, synth.trigger, self._latch_next.storage)),
+                self._latch.we.eq(sd_linklayer.rd_bank_swap | synth.hit),
+            ]
 
         self.clock_domains.cd_sd = ClockDomain(reset_less=True)
         self.comb += self.cd_sd.clk.eq(sd_linklayer.cd_sd.clk)
 
+        # Latch changes need 3 SD clocks (plus up to one for the async write)
+        # to reach the output driver; see tb_sd_events.py
         sdcd_latch = Signal(len(pins))
         self.specials += MultiReg(self._latch.storage, sdcd_latch, odomain="sd", n=3)
 
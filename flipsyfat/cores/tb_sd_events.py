@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+"""Simulation testbenches for the timing paths around the SD emulator:
+   SDTimer timestamp capture, SDTrigger output latency, and the SDEmulator
+   event/acknowledge handshake.
+
+   The link layer is Verilog and can't run in the Migen simulator, so these
+   benches drive a stand-in with the same signal names. Each latency is
+   printed in cycles of the clock it's measured in, and checked against the
+   expected values below. Scope windows are tuned against these numbers, so
+   a gateware change that moves any of them should fail here first.
+
+   Run with: python3 -m flipsyfat.cores.tb_sd_events
+   """
+
+from migen import *
+from misoc.interconnect.csr_eventmanager import *
+
+from flipsyfat.cores.sd_emulator import SDEmulator
+from flipsyfat.cores.sd_timer import SDTimer
+from flipsyfat.cores.sd_trigger import SDTrigger
+
+
+# Simulation clock periods. Only the ratio matters; 4:1 is close to an
+# 80 MHz system clock against a 25 MHz SD host.
+SYS_PERIOD = 10
+SD_PERIOD = 40
+
+# Expected latencies
+TIMER_CAPTURE_SKEW = 0          # sys cycles; timestamp is the counter on the first cycle an event is high
+TIMER_STATUS_LATENCY = 1        # sys cycles from event to updated timestamp register
+TRIGGER_LATCH_SETUP = 3         # sd cycles a latch change must lead data_out_done (MultiReg, n=3)
+TRIGGER_OUTPUT_LATENCY = 1      # sd cycles from data_out_done to the trigger pins
+TRIGGER_PULSE_WIDTH = 1         # sd cycles
+TRIGGER_AFTER_DONE_TS = SD_PERIOD // SYS_PERIOD   # sys cycles from done_ts to the trigger pins
+EVENT_IRQ_LATENCY = 1           # sys cycles from an 'act' rising edge to the interrupt
+EVENT_ACK_LATENCY = 0           # sys cycles from the pending-register ack to the 'done' pulse
+EVENT_ROUND_TRIP = 2            # sys cycles from 'act' to 'done' with an instant CPU
+
+
+class _LinkLayerStub(Module):
+    # Just the SDLinkLayer signals the add-on cores look at. The clock
+    # domain is never registered, so the only "sd" domain in the
+    # simulation is the one SDTrigger creates for itself.
+    def __init__(self):
+        self.cd_sd = ClockDomain("sd", reset_less=True)
+        self.block_read_act = Signal()
+        self.block_write_act = Signal()
+        self.data_out_done = Signal()
+        self.rd_bank_swap = Signal()
+
+
+class _TimerBench(Module):
+    def __init__(self):
+        self.ll = _LinkLayerStub()
+        self.submodules.timer = SDTimer(self.ll)
+
+
+class _TriggerBench(Module):
+    def __init__(self):
+        self.ll = _LinkLayerStub()
+        self.pins = Signal(8)
+        self.submodules.trig = SDTrigger(self.ll, self.pins)
+
+
+class _TimedTriggerBench(Module):
+    def __init__(self):
+        self.ll = _LinkLayerStub()
+        self.pins = Signal(8)
+        self.submodules.timer = SDTimer(self.ll)
+        self.submodules.trig = SDTrigger(self.ll, self.pins)
+
+
+class _EventBench(Module):
+    def __init__(self):
+        self.act = Signal()
+        self.done = Signal()
+        self.submodules.ev = EventManager()
+        self.ev.read = EventSourcePulse()
+        self.ev.finalize()
+        SDEmulator._connect_event(self, self.ev.read, self.act, self.done)
+
+
+@passive
+def _monitor(log, signals):
+    # Record every signal once per clock. Everything is sampled with the
+    # same one-edge lag, so differences between log indices are exact.
+    while True:
+        row = []
+        for s in signals:
+            row.append((yield s))
+        log.append(row)
+        yield
+
+
+def _first(log, column, cond=bool, start=0):
+    for i in range(start, len(log)):
+        if cond(log[i][column]):
+            return i
+    raise AssertionError("condition never observed in column {}".format(column))
+
+
+def _check(name, measured, expected, unit):
+    print("  {:<44} {:>3} {}".format(name, measured, unit))
+    assert measured == expected, "{}: measured {}, expected {}".format(name, measured, expected)
+
+
+def bench_timer():
+    dut = _TimerBench()
+    events = [
+        ("read_ts", dut.ll.block_read_act, dut.timer._read_ts.status),
+        ("write_ts", dut.ll.block_write_act, dut.timer._write_ts.status),
+        ("done_ts", dut.ll.data_out_done, dut.timer._done_ts.status),
+        ("capture_ts", dut.timer._capture.re, dut.timer._capture_ts.status),
+    ]
+    results = []
+
+    def driver():
+        for i in range(20):
+            yield
+        for name, trigger, status in events:
+            # Counter value during the first cycle 'trigger' is high
+            expected_ts = (yield dut.timer.cnt) + 1
+            yield trigger.eq(1)
+            yield
+            latency = 0
+            while (yield status) != expected_ts:
+                yield
+                latency += 1
+                assert latency < 16, name + " never captured"
+            results.append((name, latency, (yield status) - expected_ts))
+
+            # A held trigger must not re-capture
+            for i in range(4):
+                yield
+            assert (yield status) == expected_ts, name + " re-captured while held"
+            yield trigger.eq(0)
+            for i in range(4):
+                yield
+
+    run_simulation(dut, driver(), clocks={"sys": SYS_PERIOD})
+
+    print("SDTimer timestamp capture:")
+    for name, latency, skew in results:
+        _check(name + " capture skew", skew, TIMER_CAPTURE_SKEW, "sys cycles")
+        _check(name + " status latency", latency, TIMER_STATUS_LATENCY, "sys cycles")
+
+
+def bench_trigger():
+    dut = _TriggerBench()
+    sweep = {}
+    log = []
+
+    def pulse_done(hold=2):
+        yield dut.ll.data_out_done.eq(1)
+        for i in range(hold):
+            yield
+        yield dut.ll.data_out_done.eq(0)
+
+    def driver():
+        # Minimum latch-to-data_out_done lead time
+        for lead in range(6):
+            yield dut.trig._latch.storage.eq(0)
+            for i in range(8):
+                yield
+            yield dut.trig._latch.storage.eq(0x5a)
+            for i in range(lead):
+                yield
+            yield from pulse_done()
+            seen = 0
+            for i in range(6):
+                seen |= (yield dut.pins)
+                yield
+            sweep[lead] = seen
+
+        # Output latency and pulse width, with a settled latch
+        for i in range(8):
+            yield
+        del log[:]
+        for i in range(4):
+            yield
+        yield from pulse_done(hold=6)
+        for i in range(8):
+            yield
+
+    run_simulation(dut, {"sd": [driver(), _monitor(log, [dut.ll.data_out_done, dut.pins])]},
+        clocks={"sd": SD_PERIOD})
+
+    setup = min(lead for lead, seen in sweep.items() if seen == 0x5a)
+    for lead, seen in sweep.items():
+        assert seen in (0, 0x5a), "torn latch value {:#x} at lead {}".format(seen, lead)
+        assert (seen == 0x5a) == (lead >= setup), "latch setup is not monotonic"
+
+    done_edge = _first(log, 0)
+    pin_edge = _first(log, 1)
+    pin_fall = _first(log, 1, lambda v: v == 0, pin_edge)
+
+    print("SDTrigger output timing:")
+    _check("latch setup before data_out_done", setup, TRIGGER_LATCH_SETUP, "sd cycles")
+    _check("data_out_done to trigger pins", pin_edge - done_edge, TRIGGER_OUTPUT_LATENCY, "sd cycles")
+    _check("trigger pulse width", pin_fall - pin_edge, TRIGGER_PULSE_WIDTH, "sd cycles")
+    print("  (add up to 1 sd cycle of latch setup for the asynchronous CSR write)")
+
+
+def bench_timed_trigger():
+    dut = _TimedTriggerBench()
+    log = []
+
+    def sd_driver():
+        yield dut.trig._latch.storage.eq(0x01)
+        for i in range(8):
+            yield
+        yield dut.ll.data_out_done.eq(1)
+        for i in range(2):
+            yield
+        yield dut.ll.data_out_done.eq(0)
+        for i in range(4):
+            yield
+
+    run_simulation(dut, {
+            "sd": sd_driver(),
+            "sys": _monitor(log, [dut.timer.cnt, dut.pins, dut.timer._done_ts.status]),
+        }, clocks={"sys": SYS_PERIOD, "sd": SD_PERIOD})
+
+    pin_edge = _first(log, 1)
+    cnt_at_pin, _, done_ts = log[pin_edge]
+
+    print("SDTrigger against SDTimer:")
+    _check("done_ts to trigger pins", cnt_at_pin - done_ts, TRIGGER_AFTER_DONE_TS, "sys cycles")
+
+
+def bench_event():
+    dut = _EventBench()
+    log = []
+    pending = dut.ev.pending
+
+    def driver():
+        yield dut.ev.enable.storage.eq(1)
+        for i in range(4):
+            yield
+
+        # Link layer asserts 'act' and holds it until it sees 'done'
+        yield dut.act.eq(1)
+        while not (yield dut.ev.irq):
+            yield
+
+        # CPU acknowledges the instant it sees the interrupt
+        yield pending.re.eq(1)
+        yield pending.r.eq(1)
+        yield
+        yield pending.re.eq(0)
+        yield pending.r.eq(0)
+        for i in range(4):
+            yield
+        yield dut.act.eq(0)
+        for i in range(4):
+            yield
+
+    run_simulation(dut, [driver(), _monitor(log, [dut.act, dut.ev.irq, pending.re, dut.done, pending.w])],
+        clocks={"sys": SYS_PERIOD})
+
+    act_edge = _first(log, 0)
+    irq_edge = _first(log, 1)
+    ack_edge = _first(log, 2)
+    done_edge = _first(log, 3)
+    done_fall = _first(log, 3, lambda v: not v, done_edge)
+
+    assert log[done_fall][4] == 0, "event still pending after ack"
+    assert all(not row[1] for row in log[done_fall:]), "held 'act' raised a second event"
+
+    print("SDEmulator event path:")
+    _check("act to interrupt", irq_edge - act_edge, EVENT_IRQ_LATENCY, "sys cycles")
+    _check("ack to done", done_edge - ack_edge, EVENT_ACK_LATENCY, "sys cycles")
+    _check("round trip, instant CPU", done_edge - act_edge, EVENT_ROUND_TRIP, "sys cycles")
+    _check("done pulse width", done_fall - done_edge, 1, "sys cycles")
+
+
+def main():
+    bench_timer()
+    bench_trigger()
+    bench_timed_trigger()
+    bench_event()
+
+
+if __name__ == "__main__":
+    main()
@@ -13,8 +13,181 @@
 
 #include "sdemu.h"
 #include "hexedit.h"
+#include "screen.h"
+#include "blockmap.h"
+#include "journal.h"
+#include "bh.h"
 #include "block_guess.h"
 
+// Edited blocks live in a sparse overlay. Every other LBA comes from the
+// default generator, one of:
+enum {
+    GEN_TEMPLATE,       // The editable block_guess, same for every LBA
+    GEN_ZERO,
+    GEN_STAMP,          // Each 8 bytes: LBA, byte offset (big endian)
+    GEN_COUNT
+};
+
+#define OVERLAY_MAX_BLOCKS  4096
+#define NO_LBA              BLOCKMAP_EMPTY
+#define STATUS_LIST_LEN     32
+
+static const char *gen_names[GEN_COUNT] = { "template", "zero", "stamp" };
+static volatile int default_gen = GEN_TEMPLATE;
+static blockmap_t overlay;
+static volatile uint32_t selected_lba = NO_LBA;   // NO_LBA edits the template
+
+// A selected LBA not in the overlay shows as generated, here, until the
+// first edit copies it in. Browsing costs no overlay space.
+static uint8_t view[BLOCKMAP_BLOCK_SIZE];
+
+static bool lba_entering = false;
+static uint32_t lba_entry;
+
+
+static void default_block(uint8_t *buf, uint32_t lba)
+{
+    switch (default_gen) {
+
+        case GEN_TEMPLATE:
+            memcpy(buf, block_guess, sizeof block_guess);
+            break;
+
+        case GEN_ZERO:
+            memset(buf, 0, BLOCKMAP_BLOCK_SIZE);
+            break;
+
+        case GEN_STAMP:
+            for (uint32_t i = 0; i < BLOCKMAP_BLOCK_SIZE; i += 8) {
+                uint32_t *w = (uint32_t*) (buf + i);
+                w[0] = lba;
+                w[1] = i;
+            }
+            break;
+    }
+}
+
+static void select_block(hexedit_t *editor, uint32_t lba)
+{
+    uint8_t *block = block_guess;
+
+    if (lba != NO_LBA) {
+        block = blockmap_lookup(&overlay, lba);
+        if (!block) {
+            default_block(view, lba);
+            block = view;
+        }
+    }
+
+    // Same size, so the cursor and window carry over
+    selected_lba = lba;
+    editor->buffer = block;
+}
+
+static bool modify_block(hexedit_t *editor)
+{
+    uint8_t *block;
+
+    if (editor->buffer != view) {
+        return true;
+    }
+    block = blockmap_insert(&overlay, selected_lba, view);
+    if (!block) {
+        // Overlay full, the block stays as generated
+        return false;
+    }
+    editor->buffer = block;
+    return true;
+}
+
+static bool local_interact(hexedit_t *editor, char ch)
+{
+    if (lba_entering) {
+        switch (ch) {
+            case '0' ... '9':   lba_entry = (lba_entry << 4) | (ch - '0');          break;
+            case 'a' ... 'f':   lba_entry = (lba_entry << 4) | (10 + ch - 'a');     break;
+            case 'A' ... 'F':   lba_entry = (lba_entry << 4) | (10 + ch - 'A');     break;
+            case '\r':
+            case '\n':
+                lba_entering = false;
+                select_block(editor, lba_entry);
+                break;
+            default:
+                lba_entering = false;
+                break;
+        }
+        return true;
+    }
+
+    switch (ch) {
+        case 'L':
+            lba_entering = true;
+            lba_entry = 0;
+            return true;
+
+        case '<':
+            if (selected_lba != NO_LBA && selected_lba > 0) {
+                select_block(editor, selected_lba - 1);
+            }
+            return true;
+
+        case '>':
+            select_block(editor, selected_lba == NO_LBA ? 0 : selected_lba + 1);
+            return true;
+
+        case 'T':
+            select_block(editor, NO_LBA);
+            return true;
+
+        case 'X':
+            // Back to the default generator for this LBA
+            if (selected_lba != NO_LBA) {
+                uint32_t lba = selected_lba;
+                select_block(editor, NO_LBA);
+                blockmap_remove(&overlay, lba);
+            }
+            return true;
+
+        case 'D':
+            default_gen = (default_gen + 1) % GEN_COUNT;
+            if (editor->buffer == view) {
+                default_block(view, selected_lba);
+            }
+            return true;
+
+        case 'J':
+            journal_drain();
+            screen_invalidate();
+            return true;
+    }
+    return false;
+}
+
+static void print_overlay(void)
+{
+    int listed = 0;
+
+    screen_printf("default=%s overlay=%d/%d [", gen_names[default_gen],
+        blockmap_count(&overlay), overlay.capacity);
+
+    for (uint32_t i = 0; i < blockmap_slots(&overlay) && listed < STATUS_LIST_LEN; i++) {
+        uint32_t lba;
+        if (blockmap_slot(&overlay, i, &lba)) {
+            screen_printf(" %x", lba);
+            listed++;
+        }
+    }
+    screen_printf(listed < blockmap_count(&overlay) ? " ... ]\n" : " ]\n");
+
+    if (lba_entering) {
+        screen_printf("LBA: %x_\n", lba_entry);
+    } else if (selected_lba == NO_LBA) {
+        screen_printf("editing: template\n");
+    } else {
+        screen_printf("editing: LBA %x\n", selected_lba);
+    }
+}
+
 int main(void)
 {
     hexedit_t editor;
@@ -23,8 +196,13 @@ int main(void)
     irq_setie(1);
     time_init();
     uart_init();
+    if (!blockmap_init(&overlay, OVERLAY_MAX_BLOCKS) || !journal_init(JOURNAL_RECORDS)) {
+        puts("Not enough memory for block overlay");
+        while (1);
+    }
     sdemu_init();
     hexedit_init(&editor, block_guess, sizeof block_guess);
+    editor.modify = modify_block;
 
     puts("Blockfrob software built "__DATE__" "__TIME__"\n");
 
@@ -32,16 +210,23 @@ int main(void)
         static int last_event = 0;
         bool force_status = false;
 
+        bh_run();
+
         if (uart_read_nonblock()) {
-            force_status |= hexedit_interact(&editor, uart_read());
+            uint8_t chr = uart_read();
+            force_status |= (editor.esc_state ? 0 : local_interact(&editor, chr)) || hexedit_interact(&editor, chr);
         }
 
         if (force_status || elapsed(&last_event, CONFIG_CLOCK_FREQUENCY / 2)) {
-            printf("\e[H"); // Home
-            if (!force_status) printf("\e[J"); // Clear
+            char status[SDEMU_STATUS_LEN];
+            char journal[JOURNAL_STATUS_LEN];
+            screen_begin();
+            print_overlay();
             hexedit_print(&editor);
-            putchar('\n');
-            sdemu_status();
+            sdemu_format_status(status, sizeof status);
+            journal_format_status(journal, sizeof journal);
+            screen_printf("\n%s\n%s\n", status, journal);
+            screen_flush();
         }
     }
 
@@ -51,14 +236,35 @@ int main(void)
 
 void block_read(uint8_t *buf, uint32_t lba)
 {
-    memcpy(buf, block_guess, sizeof block_guess);
-    sdtrig_latch_write(0x01 | 
-        (lba == 0x0000 ? 0x02 : 0x00) |
-        (lba == 0x7e00 ? 0x04 : 0x00) );
+    uint8_t *block = blockmap_lookup(&overlay, lba);
+
+    if (block) {
+        memcpy(buf, block, BLOCKMAP_BLOCK_SIZE);
+    } else {
+        default_block(buf, lba);
+    }
+
+    sdemu_trigger_write(0x01 |
+        (lba == selected_lba ? 0x02 : 0x00) |
+        (block ? 0x04 : 0x00) );
 }
 
 
 void block_write(uint8_t *buf, uint32_t lba)
 {
-    // Ignored
+    // Host writes land in the same overlay as edits
+    journal_write(lba, sdtimer_write_ts_read(), buf);
+    blockmap_store(&overlay, lba, buf);
+}
+
+void block_erase(uint32_t first, uint32_t last)
+{
+    sdtimer_capture_write(0);
+    journal_discard(first, last, sdtimer_capture_ts_read());
+}
+
+bool block_erase_more(uint32_t first, uint32_t last, uint32_t *pos, uint32_t count)
+{
+    *pos = blockmap_fill_slots(&overlay, first, last, 0, *pos, count);
+    return *pos == blockmap_slots(&overlay);
 }
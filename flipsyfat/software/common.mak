@@ -12,3 +12,19 @@ LIBGCC_DIR=/usr/local/lib/gcc/lm32-elf/6.3.0
 
 COMMON := $(shell pwd)/../common
 INCLUDES += -I$(COMMON)
+
+# Emulated volume, defaults in common/fat.h. For example:
+#   make FAT_GEOMETRY="-DFAT_TYPE=32 -DFAT_PARTITION_SIZE=0x100000 -DFAT_CLUSTER_SIZE=8"
+# The volume has to fit on the card the gateware was built with (--card-blocks).
+FAT_GEOMETRY ?=
+INCLUDES += $(FAT_GEOMETRY)
+
+# ISR hot path in the integrated SRAM (common/hot.h):
+#   make HOT_SRAM=1
+ifdef HOT_SRAM
+INCLUDES += -DHOT_SRAM
+LDFLAGS += -L$(MISOC_DIRECTORY)/software/libbase
+LINKER_SCRIPT = $(COMMON)/linker-hot.ld
+else
+LINKER_SCRIPT = $(MISOC_DIRECTORY)/software/libbase/linker-sdram.ld
+endif
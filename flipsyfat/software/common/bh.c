@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <irq.h>
+
+#include "ring.h"
+#include "bh.h"
+
+typedef struct {
+    bh_func_t func;
+    uint32_t arg;
+} bh_work_t;
+
+RING_DEFINE(bh_ring, bh_work_t, BH_QUEUE_SIZE)
+
+static bh_ring_t bh_queue;
+static volatile bool bh_draining;
+uint32_t bh_refused;
+
+
+bool bh_defer(bh_func_t func, uint32_t arg)
+{
+    bh_work_t work = { func, arg };
+    unsigned int ie = irq_getie();
+    bool ok;
+
+    // Handlers may nest, so more than one can be producing
+    irq_setie(0);
+    ok = bh_draining && bh_ring_push(&bh_queue, &work);
+    if (!ok) {
+        bh_refused++;
+    }
+    irq_setie(ie);
+    return ok;
+}
+
+uint32_t bh_run(void)
+{
+    uint32_t count = 0;
+    bh_work_t work;
+
+    bh_draining = true;
+    while (bh_ring_pop(&bh_queue, &work)) {
+        work.func(work.arg);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,30 @@
+// Bottom halves: work an interrupt handler hands to the main loop
+
+#ifndef _BH_H
+#define _BH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Handlers do what can't wait, then bh_defer() the rest, which runs the
+// next time the main loop calls bh_run(). Work runs in the order it was
+// deferred, with interrupts enabled; it takes them off itself around
+// anything it shares with a handler.
+//
+// Until the app first calls bh_run() nothing drains the queue, so
+// bh_defer() refuses and the handler should do the work on the spot. It
+// also refuses when the queue is full.
+
+#define BH_QUEUE_SIZE   32
+
+typedef void (*bh_func_t)(uint32_t arg);
+
+bool bh_defer(bh_func_t func, uint32_t arg);
+
+// Runs everything deferred so far; returns how many
+uint32_t bh_run(void);
+
+// Work that couldn't be deferred since start-up, queue full or not draining
+extern uint32_t bh_refused;
+
+#endif // _BH_H
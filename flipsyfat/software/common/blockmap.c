@@ -0,0 +1,164 @@
+// Sparse store of 512-byte blocks in main RAM, keyed by LBA
+
+#include <stdint.h>
+#include <string.h>
+#include <irq.h>
+#include "blockmap.h"
+#include "sdram.h"
+
+
+bool blockmap_init(blockmap_t *map, uint32_t max_blocks)
+{
+    uint32_t slots = 2;
+    uint32_t shift = 31;
+
+    while (slots < max_blocks * 2) {
+        slots <<= 1;
+        shift--;
+    }
+
+    map->keys = sdram_alloc(slots * sizeof map->keys[0]);
+    map->slots = sdram_alloc(slots * sizeof map->slots[0]);
+    map->free_list = sdram_alloc(max_blocks * sizeof map->free_list[0]);
+    map->pool = sdram_alloc(max_blocks * BLOCKMAP_BLOCK_SIZE);
+    if (!map->keys || !map->slots || !map->free_list || !map->pool) {
+        return false;
+    }
+
+    map->mask = slots - 1;
+    map->shift = shift;
+    map->capacity = max_blocks;
+    map->num_free = max_blocks;
+
+    for (uint32_t i = 0; i < slots; i++) {
+        map->keys[i] = BLOCKMAP_EMPTY;
+        map->slots[i] = 0;
+    }
+    for (uint32_t i = 0; i < max_blocks; i++) {
+        map->free_list[i] = map->pool + (max_blocks - 1 - i) * BLOCKMAP_BLOCK_SIZE;
+    }
+    return true;
+}
+
+// Existing block, or a new uninitialized one. Interrupts must be off.
+static uint8_t *find_or_add(blockmap_t *map, uint32_t lba, bool *added)
+{
+    uint32_t i = blockmap_home(map, lba);
+    uint8_t *block;
+
+    *added = false;
+    if (!map->capacity) {
+        return 0;
+    }
+    while (map->keys[i] != BLOCKMAP_EMPTY) {
+        if (map->keys[i] == lba) {
+            return map->slots[i];
+        }
+        i = (i + 1) & map->mask;
+    }
+
+    if (!map->num_free || lba == BLOCKMAP_EMPTY) {
+        return 0;
+    }
+
+    block = map->free_list[--map->num_free];
+    map->slots[i] = block;
+    map->keys[i] = lba;
+    *added = true;
+    return block;
+}
+
+uint8_t *blockmap_insert(blockmap_t *map, uint32_t lba, const uint8_t *init)
+{
+    unsigned int ie = irq_getie();
+    uint8_t *block;
+    bool added;
+
+    irq_setie(0);
+    block = find_or_add(map, lba, &added);
+    if (added) {
+        if (init) {
+            memcpy(block, init, BLOCKMAP_BLOCK_SIZE);
+        } else {
+            memset(block, 0, BLOCKMAP_BLOCK_SIZE);
+        }
+    }
+    irq_setie(ie);
+    return block;
+}
+
+uint8_t *blockmap_store(blockmap_t *map, uint32_t lba, const uint8_t *data)
+{
+    unsigned int ie = irq_getie();
+    uint8_t *block;
+    bool added;
+
+    irq_setie(0);
+    block = find_or_add(map, lba, &added);
+    if (block) {
+        memcpy(block, data, BLOCKMAP_BLOCK_SIZE);
+    }
+    irq_setie(ie);
+    return block;
+}
+
+uint32_t blockmap_fill_slots(blockmap_t *map, uint32_t first, uint32_t last, uint8_t value,
+    uint32_t index, uint32_t count)
+{
+    uint32_t end = blockmap_slots(map);
+    unsigned int ie = irq_getie();
+
+    if (!map->capacity) {
+        return end;
+    }
+    if (index < end && count < end - index) {
+        end = index + count;
+    }
+
+    irq_setie(0);
+    for (uint32_t i = index; i < end; i++) {
+        uint32_t key = map->keys[i];
+        if (key != BLOCKMAP_EMPTY && key >= first && key <= last) {
+            memset(map->slots[i], value, BLOCKMAP_BLOCK_SIZE);
+        }
+    }
+    irq_setie(ie);
+    return end;
+}
+
+bool blockmap_remove(blockmap_t *map, uint32_t lba)
+{
+    uint32_t i = blockmap_home(map, lba);
+    unsigned int ie = irq_getie();
+
+    if (!map->capacity) {
+        return false;
+    }
+
+    irq_setie(0);
+    while (map->keys[i] != lba) {
+        if (map->keys[i] == BLOCKMAP_EMPTY) {
+            irq_setie(ie);
+            return false;
+        }
+        i = (i + 1) & map->mask;
+    }
+
+    map->free_list[map->num_free++] = map->slots[i];
+
+    // Backward shift: pull later entries of the same probe run into the
+    // hole, so lookups never need tombstones.
+    for (uint32_t j = (i + 1) & map->mask; map->keys[j] != BLOCKMAP_EMPTY; j = (j + 1) & map->mask) {
+        uint32_t home = blockmap_home(map, map->keys[j]);
+        if (((j - home) & map->mask) >= ((j - i) & map->mask)) {
+            map->keys[i] = map->keys[j];
+            map->slots[i] = map->slots[j];
+            i = j;
+        }
+    }
+    map->keys[i] = BLOCKMAP_EMPTY;
+    map->slots[i] = 0;
+
+    irq_setie(ie);
+    return true;
+}
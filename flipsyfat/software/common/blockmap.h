@@ -0,0 +1,90 @@
+// Sparse store of 512-byte blocks in main RAM, keyed by LBA
+
+#ifndef _BLOCKMAP_H
+#define _BLOCKMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Open addressing with linear probing, at most half full, so a lookup
+// touches one or two slots and is safe to call from the SD interrupt.
+//
+// Both the main loop and the interrupt may change the map; every change
+// runs with interrupts off. Lookups from the interrupt need no locking.
+// An unused map (never initialized) is empty.
+
+#define BLOCKMAP_EMPTY      0xffffffff
+#define BLOCKMAP_BLOCK_SIZE 512
+
+typedef struct blockmap_struct {
+    volatile uint32_t *keys;
+    uint8_t **slots;
+    uint8_t **free_list;
+    uint8_t *pool;
+    uint32_t mask;
+    uint32_t shift;
+    uint32_t num_free;
+    uint32_t capacity;
+} blockmap_t;
+
+// Allocates the table and up to max_blocks blocks with sdram_alloc.
+// Returns false if there isn't room.
+bool blockmap_init(blockmap_t *map, uint32_t max_blocks);
+
+static inline uint32_t blockmap_count(const blockmap_t *map)
+{
+    return map->capacity - map->num_free;
+}
+
+static inline uint32_t blockmap_home(const blockmap_t *map, uint32_t lba)
+{
+    // Fibonacci hashing; spreads runs of adjacent LBAs
+    return (lba * 2654435761u) >> map->shift;
+}
+
+static inline uint8_t *blockmap_lookup(const blockmap_t *map, uint32_t lba)
+{
+    uint32_t i = blockmap_home(map, lba);
+    uint32_t key;
+
+    if (!map->capacity) {
+        return 0;
+    }
+
+    while ((key = map->keys[i]) != BLOCKMAP_EMPTY) {
+        if (key == lba) {
+            return map->slots[i];
+        }
+        i = (i + 1) & map->mask;
+    }
+    return 0;
+}
+
+// Returns the existing block for lba, or a new one initialized from
+// 'init' (zeroes if null). Returns null when the store is full.
+uint8_t *blockmap_insert(blockmap_t *map, uint32_t lba, const uint8_t *init);
+bool blockmap_remove(blockmap_t *map, uint32_t lba);
+
+// Insert or overwrite. Returns null when the store is full.
+uint8_t *blockmap_store(blockmap_t *map, uint32_t lba, const uint8_t *data);
+
+// Overwrite every stored block from first to last with 'value', looking
+// only at the 'count' slots from 'index' on, so a big range can go in
+// pieces. Returns the slot to carry on from; blockmap_slots() once the
+// whole map is done.
+uint32_t blockmap_fill_slots(blockmap_t *map, uint32_t first, uint32_t last, uint8_t value,
+    uint32_t index, uint32_t count);
+
+// Iterate with index from 0 to blockmap_slots(); empty slots return null.
+static inline uint32_t blockmap_slots(const blockmap_t *map)
+{
+    return map->mask + 1;
+}
+
+static inline uint8_t *blockmap_slot(const blockmap_t *map, uint32_t index, uint32_t *lba)
+{
+    *lba = map->keys[index];
+    return *lba == BLOCKMAP_EMPTY ? 0 : map->slots[index];
+}
+
+#endif // _BLOCKMAP_H
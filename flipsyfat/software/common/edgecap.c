@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <generated/csr.h>
+
+#include "edgecap.h"
+
+#ifdef EDGECAP_HAS_CORE
+
+bool edgecap_enable(uint32_t rise, uint32_t fall)
+{
+    edgecap_event_t stale;
+
+    edgecap_rise_write(rise);
+    edgecap_fall_write(fall);
+    while (edgecap_pop(&stale));
+    return true;
+}
+
+bool edgecap_pop(edgecap_event_t *event)
+{
+    if (!edgecap_readable_read()) {
+        return false;
+    }
+    event->ts = edgecap_ts_read();
+    event->edges = edgecap_edges_read();
+    event->level = edgecap_after_read();
+    edgecap_pop_write(1);
+    return true;
+}
+
+uint32_t edgecap_dropped(void)
+{
+    return edgecap_dropped_read();
+}
+
+#else
+
+bool edgecap_enable(uint32_t rise, uint32_t fall)
+{
+    return false;
+}
+
+bool edgecap_pop(edgecap_event_t *event)
+{
+    return false;
+}
+
+uint32_t edgecap_dropped(void)
+{
+    return 0;
+}
+
+#endif // EDGECAP_HAS_CORE
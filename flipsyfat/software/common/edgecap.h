@@ -0,0 +1,32 @@
+#ifndef _EDGECAP_H
+#define _EDGECAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <generated/csr.h>
+
+// Edges on the victim's signals, from the edgecap core: spare header pins
+// whose rising and falling edges queue up timestamped on the sdtimer
+// counter, so "block done to pin edge" is one subtraction.
+
+#ifdef CSR_EDGECAP_BASE
+#define EDGECAP_HAS_CORE
+#endif
+
+typedef struct {
+    uint32_t ts;                // sdtimer count, two cycles after the edge
+    uint32_t edges;             // Pins with an enabled edge at ts
+    uint32_t level;             // All pins just after
+} edgecap_event_t;
+
+// Pins to timestamp on each edge; anything queued before is discarded.
+// Returns false if there's no core to do that.
+bool edgecap_enable(uint32_t rise, uint32_t fall);
+
+// Oldest queued edge, if any
+bool edgecap_pop(edgecap_event_t *event);
+
+// Edges lost to a full queue
+uint32_t edgecap_dropped(void);
+
+#endif // _EDGECAP_H
@@ -1,13 +1,19 @@
-// Tiny FAT16 emulation
+// Tiny FAT12/16/32 emulation
 
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+#include <irq.h>
 #include <generated/csr.h>
 
 #include "fat.h"
 #include "sdemu.h"
+#include "journal.h"
+
+#if defined(CONFIG_SDEMU_CARD_BLOCKS) && FAT_PARTITION_END >= CONFIG_SDEMU_CARD_BLOCKS
+#error "FAT volume does not fit on the emulated card"
+#endif
 
 const char* fat_oem_name = "FAKEDOS";
 const char* fat_volume_name = "FLIPSY";
@@ -16,14 +22,228 @@ const uint32_t fat_volume_serial = 0xf00d1e55;
 uint32_t fat_trace_buffer_block[FAT_TRACE_BUFFER_SIZE];
 uint32_t fat_trace_buffer_index = 0;
 
+blockmap_t fat_overlay;
+uint32_t fat_erases_lost = 0;
+
+static uint32_t exclude_first = 1;
+static uint32_t exclude_last = 0;
+
+// Erased ranges, kept apart and in no order
+static struct {
+    uint32_t first, last;
+} erased[FAT_ERASED_RANGES];
+static uint32_t num_erased = 0;
+
+uint32_t fat_chain_first = 0;
+uint32_t fat_chain_last = 0;
+
+#ifdef SDEMU_HAS_SYNTH
+// Parts of the synthesizer's range the host has written
+static uint32_t fat_synth_written = 0;
+#endif
+
+
+static void fat_boot_sector(uint8_t *buf)
+{
+    memset(buf, 0, BLOCK_SIZE);
+    fat_boot_signature(buf);
+    fat_string(buf+0x03, fat_oem_name, 8);
+    fat_uint16(buf+0x0b, BLOCK_SIZE);
+    buf[0x0d] = FAT_CLUSTER_SIZE;
+    fat_uint16(buf+0x0e, FAT_RESERVED_SECTORS);
+    buf[0x10] = FAT_NUM_TABLES;
+    buf[0x15] = FAT_MEDIA_DESCRIPTOR;
+    fat_uint16(buf+0x18, FAT_SECTORS_PER_TRACK);
+    fat_uint16(buf+0x1a, FAT_CHS_HEADS);
+    fat_uint32(buf+0x1c, FAT_HIDDEN_SECTORS);
+
+#if FAT_TYPE == 32
+    fat_uint24(buf, 0x9058eb);      // Jump to 0x5a
+    fat_uint16(buf+0x5a, 0x19cd);   // Int 19h, reboot
+    fat_uint32(buf+0x20, FAT_PARTITION_SIZE);
+    fat_uint32(buf+0x24, FAT_SECTORS_PER_TABLE);
+    fat_uint32(buf+0x2c, FAT_ROOT_CLUSTER);
+    fat_uint16(buf+0x30, FAT_FSINFO_SECTOR);
+    fat_uint16(buf+0x32, FAT_BACKUP_BOOT_SECTOR);
+    buf += 0x1c;                    // Rest of the EBPB is the FAT16 one, moved up
+#else
+    fat_uint24(buf, 0x903ceb);      // Jump to 0x3e
+    fat_uint16(buf+0x3e, 0x19cd);   // Int 19h, reboot
+    fat_uint16(buf+0x11, FAT_MAX_ROOT_ENTRIES);
+#if FAT_PARTITION_SIZE < 0x10000
+    fat_uint16(buf+0x13, FAT_PARTITION_SIZE);
+#else
+    fat_uint32(buf+0x20, FAT_PARTITION_SIZE);
+#endif
+    fat_uint16(buf+0x16, FAT_SECTORS_PER_TABLE);
+#endif
+
+    buf[0x24] = FAT_PHYSICAL_DRIVE_NUM;
+    buf[0x26] = FAT_EXT_BOOT_SIGNATURE;
+    fat_uint32(buf+0x27, fat_volume_serial);
+    fat_string(buf+0x2b, fat_volume_name, 11);
+    fat_string(buf+0x36, FAT_FILESYSTEM_TYPE, 8);
+}
+
+static void fat_reserved_sector(uint8_t *buf, unsigned sector)
+{
+    switch (sector) {
+
+    case 0:
+#if FAT_TYPE == 32
+    case FAT_BACKUP_BOOT_SECTOR:
+#endif
+        fat_boot_sector(buf);
+        break;
+
+#if FAT_TYPE == 32
+    case FAT_FSINFO_SECTOR:
+    case FAT_BACKUP_BOOT_SECTOR + FAT_FSINFO_SECTOR:
+        memset(buf, 0, BLOCK_SIZE);
+        fat_uint32(buf, 0x41615252);
+        fat_uint32(buf+0x1e4, 0x61417272);
+        fat_uint32(buf+0x1e8, 0xffffffff);      // Free count unknown
+        fat_uint32(buf+0x1ec, 0xffffffff);      // No next-free hint
+        fat_boot_signature(buf);
+        break;
+#endif
+
+    default:
+        memset(buf, 0, BLOCK_SIZE);
+    }
+}
+
+static void fat_table_sector(uint8_t *buf, unsigned sector)
+{
+#if FAT_TYPE == 32
+    for (int i = 0; i < 0x80; i++) {
+        fat_uint32(buf+i*4, fat_table_entry(sector*0x80 + i));
+    }
+#elif FAT_TYPE == 16
+    for (int i = 0; i < 0x100; i++) {
+        fat_uint16(buf+i*2, fat_table_entry(sector*0x100 + i));
+    }
+#else
+    // Entry pairs pack into 3 bytes and straddle sectors, so build each
+    // byte from the entry or two it holds bits of.
+    uint32_t byte = sector * BLOCK_SIZE;
+    for (int i = 0; i < BLOCK_SIZE; i++, byte++) {
+        unsigned cluster = byte * 2 / 3;
+        uint32_t value = fat_table_entry(cluster);
+        switch (byte % 3) {
+            case 0: buf[i] = value; break;
+            case 1: buf[i] = (value >> 8) | (fat_table_entry(cluster + 1) << 4); break;
+            case 2: buf[i] = value >> 4; break;
+        }
+    }
+#endif
+}
+
+// Host writes win over generated blocks, so stop the hardware making these
+static void fat_synth_overwritten(uint32_t first, uint32_t last)
+{
+#ifdef SDEMU_HAS_SYNTH
+    uint32_t bits = 0;
+
+    if (first <= FAT_TABLE_END && last >= FAT_TABLE_START) {
+        bits |= SDEMU_SYNTH_FAT;
+    }
+    if (first <= FAT_ROOT_END && last >= FAT_ROOT_START) {
+        bits |= SDEMU_SYNTH_ROOT;
+    }
+    if (bits) {
+        fat_synth_written |= bits;
+        sdemu_synth_enable_write(sdemu_synth_enable_read() & ~bits);
+    }
+#endif
+}
+
+void fat_overlay_exclude(uint32_t first, uint32_t last)
+{
+    unsigned int ie = irq_getie();
+
+    irq_setie(0);
+    exclude_first = first;
+    exclude_last = last;
+    irq_setie(ie);
+}
+
+static bool fat_excluded(uint32_t lba)
+{
+    return lba >= exclude_first && lba <= exclude_last;
+}
+
+static bool fat_erased(uint32_t lba)
+{
+    for (uint32_t i = 0; i < num_erased; i++) {
+        if (lba >= erased[i].first && lba <= erased[i].last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// With interrupts off
+static void fat_record_erase(uint32_t first, uint32_t last)
+{
+    uint32_t i = 0;
+
+    // Absorb every range this one overlaps or touches
+    while (i < num_erased) {
+        if (erased[i].first <= last + 1 && first <= erased[i].last + 1) {
+            if (erased[i].first < first) first = erased[i].first;
+            if (erased[i].last > last) last = erased[i].last;
+            erased[i] = erased[--num_erased];
+            i = 0;      // Grown, may touch one passed over
+        } else {
+            i++;
+        }
+    }
+    if (num_erased == FAT_ERASED_RANGES) {
+        fat_erases_lost++;
+        return;
+    }
+    erased[num_erased].first = first;
+    erased[num_erased].last = last;
+    num_erased++;
+}
+
+// Which part of the volume, for the trigger outputs
+static uint32_t fat_trigger(uint32_t lba)
+{
+    if (lba >= FAT_ROOT_START && lba < FAT_ROOT_END) {
+        return 0x01 | 0x02;
+    }
+    if (lba >= FAT_ROOT_END && lba <= FAT_PARTITION_END) {
+        return 0x01 | 0x08;
+    }
+    return 0x01;
+}
 
 void block_read(uint8_t *buf, uint32_t lba)
 {
+    uint8_t *written = 0;
+    bool excluded = fat_excluded(lba);
+
     if (fat_trace_buffer_index < FAT_TRACE_BUFFER_SIZE) {
         fat_trace_buffer_block[fat_trace_buffer_index++] = lba;
     }
 
-    sdtrig_latch_write(0x01);
+    if (!excluded) {
+        written = blockmap_lookup(&fat_overlay, lba);
+    }
+    if (written) {
+        memcpy(buf, written, BLOCK_SIZE);
+        sdemu_trigger_write(fat_trigger(lba) | 0x20);
+        return;
+    }
+    if (!excluded && num_erased && fat_erased(lba)) {
+        memset(buf, 0, BLOCK_SIZE);
+        sdemu_trigger_write(fat_trigger(lba) | 0x20);
+        return;
+    }
+
+    sdemu_trigger_write(fat_trigger(lba));
 
     switch (lba) {
 
@@ -41,49 +261,21 @@ void block_read(uint8_t *buf, uint32_t lba)
         break;
     }
 
-    // FAT Boot Sector
-    case FAT_PARTITION_START: {
-        memset(buf, 0, BLOCK_SIZE);
-        fat_boot_signature(buf);
-        fat_uint24(buf, 0x903ceb);      // Jump to 0x3e
-        fat_uint16(buf+0x3e, 0x19cd);   // Int 19h, reboot
-        fat_string(buf+0x03, fat_oem_name, 8);
-        fat_uint16(buf+0x0b, BLOCK_SIZE);
-        buf[0x0d] = FAT_CLUSTER_SIZE;
-        fat_uint16(buf+0x0e, FAT_RESERVED_SECTORS);
-        buf[0x10] = FAT_NUM_TABLES;
-        fat_uint16(buf+0x11, FAT_MAX_ROOT_ENTRIES);
-        fat_uint16(buf+0x13, FAT_PARTITION_SIZE);
-        buf[0x15] = FAT_MEDIA_DESCRIPTOR;
-        fat_uint16(buf+0x16, FAT_SECTORS_PER_TABLE);
-        fat_uint16(buf+0x18, FAT_SECTORS_PER_TRACK);
-        fat_uint16(buf+0x1a, FAT_CHS_HEADS);
-        fat_uint16(buf+0x1c, FAT_HIDDEN_SECTORS);
-        buf[0x24] = FAT_PHYSICAL_DRIVE_NUM;
-        buf[0x26] = FAT_EXT_BOOT_SIGNATURE;
-        fat_uint32(buf+0x27, fat_volume_serial);
-        fat_string(buf+0x2b, fat_volume_name, 11);
-        fat_string(buf+0x36, FAT_FILESYSTEM_TYPE, 8);
+    // Boot Sector, and on FAT32 the FSInfo and backups
+    case FAT_PARTITION_START ... FAT_TABLE_START - 1: {
+        fat_reserved_sector(buf, lba - FAT_PARTITION_START);
         break;
     }
 
     // FAT Tables 1 + 2
     case FAT_TABLE_START ... FAT_TABLE_END: {
-        unsigned sector = (lba - FAT_TABLE_START) % FAT_SECTORS_PER_TABLE;
-        for (int i = 0; i < FAT_ENTRIES_PER_SECTOR; i++) {
-            fat_table_entry(buf+i*2, sector*FAT_ENTRIES_PER_SECTOR + i);
-        }
+        fat_table_sector(buf, (lba - FAT_TABLE_START) % FAT_SECTORS_PER_TABLE);
         break;
     }
 
     // Root Directory
     case FAT_ROOT_START ... FAT_ROOT_END: {
         unsigned start = (lba - FAT_ROOT_START) * FAT_DENTRY_PER_SECTOR;
-        if (lba == FAT_ROOT_END) {
-            sdtrig_latch_write(sdtrig_latch_read() | 0x08);
-        } else {
-            sdtrig_latch_write(sdtrig_latch_read() | 0x02);
-        }
         for (int i = 0; i < FAT_DENTRY_PER_SECTOR; i++) {
             fat_rootdir_entry(buf+i*FAT_DENTRY_SIZE, start+i);
         }
@@ -91,10 +283,9 @@ void block_read(uint8_t *buf, uint32_t lba)
     }
 
     // File Clusters
-    case FAT_ROOT_END + 1 ... FAT_PARTITION_START + FAT_PARTITION_SIZE - 1: {
-        unsigned cluster = 2 + ((lba - FAT_ROOT_END - 1) / FAT_CLUSTER_SIZE);
-        unsigned offset = (lba - FAT_ROOT_END - 1) % FAT_CLUSTER_SIZE;
-        sdtrig_latch_write(sdtrig_latch_read() | 0x08);
+    case FAT_ROOT_END + 1 ... FAT_PARTITION_END: {
+        unsigned cluster = 2 + ((lba - FAT_DATA_START) / FAT_CLUSTER_SIZE);
+        unsigned offset = (lba - FAT_DATA_START) % FAT_CLUSTER_SIZE;
         fat_data_block(buf, cluster, offset);
         break;
     }
@@ -108,5 +299,94 @@ void block_read(uint8_t *buf, uint32_t lba)
 
 void block_write(uint8_t *buf, uint32_t lba)
 {
-    // Ignored
+    journal_write(lba, sdtimer_write_ts_read(), buf);
+    if (fat_excluded(lba)) {
+        return;
+    }
+    blockmap_store(&fat_overlay, lba, buf);
+    fat_synth_overwritten(lba, lba);
+}
+
+void block_erase(uint32_t first, uint32_t last)
+{
+    sdtimer_capture_write(0);
+    journal_discard(first, last, sdtimer_capture_ts_read());
+
+    if (first >= exclude_first && last <= exclude_last) {
+        return;
+    }
+    unsigned int ie = irq_getie();
+    irq_setie(0);
+    fat_record_erase(first, last);
+    irq_setie(ie);
+    fat_synth_overwritten(first, last);
+}
+
+bool block_erase_more(uint32_t first, uint32_t last, uint32_t *pos, uint32_t count)
+{
+    // Stored blocks, by overlay slot; the range can be the whole card
+    if (first >= exclude_first && last <= exclude_last) {
+        return true;
+    }
+    *pos = blockmap_fill_slots(&fat_overlay, first, last, 0, *pos, count);
+    return *pos == blockmap_slots(&fat_overlay);
+}
+
+bool fat_synth_tables(bool enable)
+{
+#if defined(SDEMU_HAS_SYNTH) && FAT_TYPE == 16
+    unsigned int ie = irq_getie();
+    uint32_t bits;
+
+    irq_setie(0);
+    bits = sdemu_synth_enable_read() & ~SDEMU_SYNTH_FAT;
+    sdemu_synth_enable_write(bits);
+
+    if (enable && !(fat_synth_written & SDEMU_SYNTH_FAT)) {
+        sdemu_synth_fat_start_write(FAT_TABLE_START);
+        sdemu_synth_fat_sectors_write(FAT_SECTORS_PER_TABLE);
+        sdemu_synth_fat_media_write(fat_table_entry(0));
+        sdemu_synth_chain_first_write(fat_chain_first);
+        sdemu_synth_chain_last_write(fat_chain_last);
+        sdemu_synth_cluster_limit_write(FAT_CLUSTER_COUNT + 2);
+        sdemu_synth_trig_fat_write(0x01);
+        bits |= SDEMU_SYNTH_FAT;
+        sdemu_synth_enable_write(bits);
+    }
+
+    irq_setie(ie);
+    return (bits & SDEMU_SYNTH_FAT) != 0;
+#else
+    // FAT12 and FAT32 tables stay in software
+    return false;
+#endif
+}
+
+bool fat_synth_root(const uint8_t *dentry)
+{
+#ifdef SDEMU_HAS_SYNTH
+    unsigned int ie = irq_getie();
+    uint32_t bits;
+
+    irq_setie(0);
+    bits = sdemu_synth_enable_read() & ~SDEMU_SYNTH_ROOT;
+    sdemu_synth_enable_write(bits);
+
+    if (dentry && !(fat_synth_written & SDEMU_SYNTH_ROOT) && FAT_ROOT_END > FAT_ROOT_START) {
+        uint8_t label[FAT_DENTRY_SIZE];
+        fat_volume_label(label);
+        memcpy(SDEMU_SYNTH_LABEL, label, FAT_DENTRY_SIZE);
+        memcpy(SDEMU_SYNTH_TEMPLATE, dentry, FAT_DENTRY_SIZE);
+        sdemu_synth_root_start_write(FAT_ROOT_START);
+        sdemu_synth_root_end_write(FAT_ROOT_END - 1);
+        sdemu_synth_trig_root_write(0x01 | 0x02);
+        bits |= SDEMU_SYNTH_ROOT;
+        sdemu_synth_enable_write(bits);
+    }
+
+    irq_setie(ie);
+    return (bits & SDEMU_SYNTH_ROOT) != 0;
+#else
+    return false;
+#endif
 }
@@ -1,4 +1,4 @@
-// Tiny FAT16 emulation
+// Tiny FAT12/16/32 emulation
 
 #ifndef _FAT_H
 #define _FAT_H
@@ -6,14 +6,48 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include "blockmap.h"
 
+// Volume geometry. Defaults are a ~31 MB FAT16 volume; builds pick another
+// with -D, e.g. -DFAT_TYPE=32 -DFAT_PARTITION_SIZE=0x1000000 -DFAT_CLUSTER_SIZE=8.
+// Everything else, including the FAT size, is derived from these.
+#ifndef FAT_TYPE
+#define FAT_TYPE                16
+#endif
+#ifndef FAT_PARTITION_START
 #define FAT_PARTITION_START     0x3f
+#endif
+#ifndef FAT_PARTITION_SIZE
 #define FAT_PARTITION_SIZE      0xf480
+#endif
+#ifndef FAT_CLUSTER_SIZE
 #define FAT_CLUSTER_SIZE        4
+#endif
+
+#if FAT_TYPE == 32
+#define FAT_RESERVED_SECTORS    0x20
+#define FAT_ROOT_CLUSTERS       ((0x20 + FAT_CLUSTER_SIZE - 1) / FAT_CLUSTER_SIZE)
+#define FAT_MAX_ROOT_ENTRIES    (FAT_ROOT_CLUSTERS * FAT_CLUSTER_SIZE * FAT_DENTRY_PER_SECTOR)
+#define FAT_EOC                 0x0fffffff
+#define FAT_PARTITION_TYPE      0x0c     // FAT32 LBA
+#define FAT_FILESYSTEM_TYPE     "FAT32"
+#elif FAT_TYPE == 16
+#define FAT_RESERVED_SECTORS    1
+#define FAT_MAX_ROOT_ENTRIES    0x200
+#define FAT_EOC                 0xffff
+#define FAT_PARTITION_TYPE      0x0b
+#define FAT_FILESYSTEM_TYPE     "FAT16"
+#elif FAT_TYPE == 12
 #define FAT_RESERVED_SECTORS    1
 #define FAT_MAX_ROOT_ENTRIES    0x200
-#define FAT_SECTORS_PER_TABLE   0x3e
-#define FAT_ENTRIES_PER_SECTOR  0x100
+#define FAT_EOC                 0xfff
+#define FAT_PARTITION_TYPE      0x01
+#define FAT_FILESYSTEM_TYPE     "FAT12"
+#else
+#error "FAT_TYPE must be 12, 16 or 32"
+#endif
+
+#define FAT_SECTOR_SIZE         0x200
 #define FAT_NUM_TABLES          2
 #define FAT_DENTRY_SIZE         0x20
 #define FAT_DENTRY_PER_SECTOR   0x10
@@ -21,14 +55,55 @@
 #define FAT_PHYSICAL_DRIVE_NUM  0x80     // DOS drive
 #define FAT_SECTORS_PER_TRACK   0x20     // Legacy CHS
 #define FAT_CHS_HEADS           0x10
-#define FAT_HIDDEN_SECTORS      0x3f
-#define FAT_EXT_BOOT_SIGNATURE  0x29     // Dos 4.0-style FAT16 EBPB
-#define FAT_FILESYSTEM_TYPE     "FAT16"
+#define FAT_HIDDEN_SECTORS      FAT_PARTITION_START
+#define FAT_EXT_BOOT_SIGNATURE  0x29     // Dos 4.0-style EBPB
+
+// FAT32 only: FSInfo and backup boot sectors, relative to the partition
+#define FAT_FSINFO_SECTOR       1
+#define FAT_BACKUP_BOOT_SECTOR  6
 
+// Root directory. FAT12/16 have a fixed region between the FATs and the
+// data, FAT32 a chain of whole clusters at the start of the data.
+#define FAT_ROOT_SECTORS        (FAT_MAX_ROOT_ENTRIES / FAT_DENTRY_PER_SECTOR)
+#if FAT_TYPE == 32
+#define FAT_ROOT_CLUSTER        2
+#define FAT_ROOT_REGION         0
+#else
+#define FAT_ROOT_CLUSTER        0
+#define FAT_ROOT_CLUSTERS       0
+#define FAT_ROOT_REGION         FAT_ROOT_SECTORS
+#endif
+
+// FAT size, as in Microsoft's FAT specification. It may round up a little,
+// but never comes out short.
+#if FAT_TYPE == 32
+#define FAT_SIZE_DIVISOR        ((256 * FAT_CLUSTER_SIZE + FAT_NUM_TABLES) / 2)
+#else
+#define FAT_SIZE_DIVISOR        (256 * FAT_CLUSTER_SIZE + FAT_NUM_TABLES)
+#endif
+#define FAT_SECTORS_PER_TABLE   ((FAT_PARTITION_SIZE - FAT_RESERVED_SECTORS - FAT_ROOT_REGION \
+                                  + FAT_SIZE_DIVISOR - 1) / FAT_SIZE_DIVISOR)
+
+// Region boundaries, as absolute LBAs
 #define FAT_TABLE_START         (FAT_PARTITION_START + FAT_RESERVED_SECTORS)
 #define FAT_TABLE_END           (FAT_TABLE_START + FAT_SECTORS_PER_TABLE*FAT_NUM_TABLES - 1)
-#define FAT_ROOT_START          (FAT_TABLE_END + 1)
-#define FAT_ROOT_END            (FAT_ROOT_START + FAT_MAX_ROOT_ENTRIES/16 - 1)
+#define FAT_DATA_START          (FAT_TABLE_END + 1 + FAT_ROOT_REGION)
+#define FAT_ROOT_START          (FAT_TYPE == 32 ? FAT_DATA_START : FAT_TABLE_END + 1)
+#define FAT_ROOT_END            (FAT_ROOT_START + FAT_ROOT_SECTORS - 1)
+#define FAT_PARTITION_END       (FAT_PARTITION_START + FAT_PARTITION_SIZE - 1)
+#define FAT_CLUSTER_COUNT       ((FAT_PARTITION_END + 1 - FAT_DATA_START) / FAT_CLUSTER_SIZE)
+
+// Generated chains link this many clusters, then end. One FAT sector's worth
+// for FAT16/32.
+#define FAT_CHAIN_RUN           (FAT_TYPE == 32 ? 0x80 : 0x100)
+
+#if FAT_TYPE == 12 && FAT_CLUSTER_COUNT >= 4085
+#error "Too many clusters for FAT12"
+#elif FAT_TYPE == 16 && (FAT_CLUSTER_COUNT < 4085 || FAT_CLUSTER_COUNT >= 65525)
+#error "Cluster count out of range for FAT16"
+#elif FAT_TYPE == 32 && FAT_CLUSTER_COUNT < 65525
+#error "Too few clusters for FAT32"
+#endif
 
 extern const char* fat_oem_name;
 extern const char* fat_volume_name;
@@ -39,6 +114,36 @@ extern const uint32_t fat_volume_serial;
 extern uint32_t fat_trace_buffer_block[FAT_TRACE_BUFFER_SIZE];
 extern uint32_t fat_trace_buffer_index;
 
+// Blocks the host has written, returned in place of generated ones.
+// Unused until the app calls blockmap_init() on it. Erased ranges read
+// back as zeroes; past FAT_ERASED_RANGES separate ones, further erases of
+// blocks never written are forgotten and counted in fat_erases_lost.
+extern blockmap_t fat_overlay;
+#define FAT_OVERLAY_BLOCKS      1024
+#define FAT_ERASED_RANGES       16
+extern uint32_t fat_erases_lost;
+
+// Blocks from first to last stay generated whatever the host does; its
+// writes are journaled and dropped. For experiments that must see every
+// read of their blocks. None to begin with.
+void fat_overlay_exclude(uint32_t first, uint32_t last);
+
+// Clusters from first to last form one chain, even across FAT sectors.
+// Disabled while last is zero.
+extern uint32_t fat_chain_first;
+extern uint32_t fat_chain_last;
+
+// Blocks the sdemu core generates by itself, if the gateware has the
+// synthesizer; they never reach block_read() or the trace buffer.
+// fat_synth_tables() hands it the FAT16 tables, and needs calling again
+// after the chain changes. fat_synth_root() replicates 'dentry' over every
+// root directory sector but the last, which stays in software so scans
+// still end in fat_rootdir_entry(); NULL gives them all back. Both return
+// whether hardware is serving those blocks now. A host write to any of
+// them gives them back to the overlay for good.
+bool fat_synth_tables(bool enable);
+bool fat_synth_root(const uint8_t *dentry);
+
 // Callbacks
 extern void fat_rootdir_entry(uint8_t* dest, unsigned index);
 extern void fat_data_block(uint8_t* dest, unsigned cluster, unsigned index);
@@ -87,26 +192,37 @@ static inline void fat_partition(uint8_t* entry, uint32_t first_sector, uint32_t
 {
     entry[0] = 0x00;                    // Status
     fat_uint24(entry+1, 0x000101);      // First CHS
-    entry[4] = 0x0b;                    // Type
+    entry[4] = FAT_PARTITION_TYPE;
     fat_uint24(entry+5, 0xfffffe);      // Last CHS
     fat_uint32(entry+8, first_sector);
     fat_uint32(entry+12, size);
 }
 
-static inline void fat_table_entry(uint8_t* dest, unsigned cluster)
+static inline uint32_t fat_table_entry(unsigned cluster)
 {
     if (cluster == 0) {
         // Special case
-        fat_uint16(dest, 0xff00 | FAT_MEDIA_DESCRIPTOR);
+        return (FAT_EOC & ~0xff) | FAT_MEDIA_DESCRIPTOR;
+
+    } else if (cluster == 1) {
+        return FAT_EOC;
+
+    } else if (cluster < FAT_ROOT_CLUSTER + FAT_ROOT_CLUSTERS) {
+        // FAT32 root directory chain
+        return cluster == FAT_ROOT_CLUSTER + FAT_ROOT_CLUSTERS - 1 ? FAT_EOC : cluster + 1;
 
-    } else if (cluster < FAT_PARTITION_SIZE / FAT_CLUSTER_SIZE) {
-        // Chain all clusters within a sector, let the last one be the end.
-        bool last_in_sector = (cluster % FAT_ENTRIES_PER_SECTOR) == (FAT_ENTRIES_PER_SECTOR - 1);
-        fat_uint16(dest, last_in_sector ? 0xffff : cluster + 1);
+    } else if (cluster >= fat_chain_first && cluster <= fat_chain_last) {
+        // Contiguous file, possibly longer than one FAT sector
+        return cluster == fat_chain_last ? FAT_EOC : cluster + 1;
+
+    } else if (cluster < FAT_CLUSTER_COUNT + 2) {
+        // Chain clusters in short runs, let the last one be the end.
+        bool last_in_run = (cluster % FAT_CHAIN_RUN) == (FAT_CHAIN_RUN - 1);
+        return last_in_run ? FAT_EOC : cluster + 1;
 
     } else {
         // Unused table entry
-        fat_uint16(dest, 0x0000);
+        return 0;
     }
 }
 
@@ -123,8 +239,102 @@ static inline void fat_plain_file(uint8_t *dest, const char *name, const char *e
     memset(dest, 0, FAT_DENTRY_SIZE);
     fat_string(dest, name, 8);
     fat_string(dest+0x08, ext, 3);
+    fat_uint16(dest+0x14, first_cluster >> 16);   // FAT32 only
     fat_uint16(dest+0x1a, first_cluster);
     fat_uint32(dest+0x1c, filesize);
 }
 
+static inline void fat_subdir_entry(uint8_t *dest, const char *name, const char *ext,
+    unsigned first_cluster)
+{
+    fat_plain_file(dest, name, ext, first_cluster, 0);
+    dest[0x0b] = 0x10;
+}
+
+// "." or ".." at the start of a subdirectory; the root is cluster 0
+static inline void fat_dot_entry(uint8_t *dest, const char *dots, unsigned cluster)
+{
+    fat_plain_file(dest, dots, "", cluster, 0);
+    dest[0x0b] = 0x10;
+}
+
+// VFAT long filenames. A name is split into parts of FAT_LFN_CHARS, each in
+// an entry placed before the short entry, last part first. Every part
+// carries a checksum of the short name it belongs to.
+#define FAT_LFN_CHARS           13
+
+// Where character 'i' of a part is stored; UCS-2, in three runs
+static inline unsigned fat_lfn_offset(int i)
+{
+    return i < 5 ? 0x01 + 2*i : i < 11 ? 0x0e + 2*(i-5) : 0x1c + 2*(i-11);
+}
+
+static inline uint8_t fat_lfn_checksum(const uint8_t *short_name)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+    }
+    return sum;
+}
+
+static inline unsigned fat_lfn_count(unsigned len)
+{
+    return (len + FAT_LFN_CHARS - 1) / FAT_LFN_CHARS;
+}
+
+// Part 'seq' (from 1) of an ASCII long name
+static inline void fat_lfn_entry(uint8_t *dest, const char *name, unsigned len,
+    unsigned seq, uint8_t checksum)
+{
+    unsigned first = (seq - 1) * FAT_LFN_CHARS;
+
+    memset(dest, 0, FAT_DENTRY_SIZE);
+    dest[0x00] = seq | (first + FAT_LFN_CHARS >= len ? 0x40 : 0);
+    dest[0x0b] = 0x0f;
+    dest[0x0d] = checksum;
+    for (int i = 0; i < FAT_LFN_CHARS; i++) {
+        unsigned pos = first + i;
+        fat_uint16(dest + fat_lfn_offset(i),
+            pos < len ? (uint8_t) name[pos] : pos == len ? 0x0000 : 0xffff);
+    }
+}
+
+// Appends the ASCII characters of one part to 'dest', returns how many
+static inline unsigned fat_lfn_chars(char *dest, const uint8_t *entry)
+{
+    unsigned count = 0;
+    for (int i = 0; i < FAT_LFN_CHARS; i++) {
+        const uint8_t *p = entry + fat_lfn_offset(i);
+        uint16_t ch = p[0] | (p[1] << 8);
+        if (ch == 0x0000 || ch == 0xffff) break;
+        dest[count++] = ch < 0x80 ? ch : '?';
+    }
+    return count;
+}
+
+// A file with a long name: the LFN entries and then the short entry, at
+// most FAT_LFN_CHARS * 'max_lfn' characters. Returns the number of entries.
+static inline unsigned fat_long_file(uint8_t *dest, const char *long_name,
+    const char *name, const char *ext, unsigned first_cluster, unsigned filesize,
+    unsigned max_lfn)
+{
+    unsigned len = strlen(long_name);
+    unsigned parts = fat_lfn_count(len);
+    uint8_t *short_entry;
+
+    if (parts > max_lfn) {
+        parts = max_lfn;
+        len = parts * FAT_LFN_CHARS;
+    }
+    short_entry = dest + parts * FAT_DENTRY_SIZE;
+    fat_plain_file(short_entry, name, ext, first_cluster, filesize);
+
+    uint8_t checksum = fat_lfn_checksum(short_entry);
+    for (unsigned i = 0; i < parts; i++) {
+        fat_lfn_entry(dest + i * FAT_DENTRY_SIZE, long_name, len, parts - i, checksum);
+    }
+    return parts + 1;
+}
+
 #endif // _FAT_H
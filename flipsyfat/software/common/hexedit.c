@@ -1,8 +1,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
-#include <uart.h>
 #include "hexedit.h"
+#include "screen.h"
 
 #ifndef MIN
 #define MIN(a,b) ((a)<(b)?(a):(b))
@@ -126,6 +126,10 @@ bool hexedit_interact(hexedit_t* editor, uint8_t chr)
                     editor->cursor_data_width++;
                     break;
 
+                case '\f':
+                    screen_invalidate();
+                    break;
+
                 default:
                     return false;
             }
@@ -163,6 +167,10 @@ bool hexedit_interact(hexedit_t* editor, uint8_t chr)
 
     hexedit_validate(editor);
 
+    if ((delta != 0 || entered_byte >= 0) && editor->modify && !editor->modify(editor)) {
+        return true;
+    }
+
     if (delta != 0) {
 
         // Arbitrary width little endian add
@@ -213,29 +221,29 @@ void hexedit_print(hexedit_t* editor)
 {
     for (uint16_t y = 0; y < editor->window_height; y++) {
         uint32_t addr = editor->window_addr + editor->window_width * y;
-        printf("%8x: %c", addr, interbyte_char(editor, addr, -1));
+        screen_printf("%8x: %c", addr, interbyte_char(editor, addr, -1));
 
         for (uint16_t x = 0; x < editor->window_width; x++) {
             uint32_t xaddr = addr + x;
             uint32_t caddr = xaddr - editor->cursor_low;
             if (editor->hex_nybble >= 0 && caddr < editor->cursor_size) {
-                printf("%x_", editor->hex_nybble);
+                screen_printf("%x_", editor->hex_nybble);
             } else {
                 uint8_t chr = editor->buffer[xaddr];
-                printf("%02x", chr);
+                screen_printf("%02x", chr);
             }
-            putchar(interbyte_char(editor, xaddr + 1, xaddr));
+            screen_putchar(interbyte_char(editor, xaddr + 1, xaddr));
         }
 
         for (uint16_t x = 0; x < editor->window_width; x++) {
             uint8_t chr = editor->buffer[addr + x];
-            putchar((chr < 0x80 && isprint(chr)) ? chr : '.');
+            screen_putchar((chr < 0x80 && isprint(chr)) ? chr : '.');
         }
 
         if ((uint32_t)(editor->cursor_low - addr) < editor->window_width) {
-            printf(" @%04x*%x", editor->cursor_low, editor->cursor_size);
+            screen_printf(" @%04x*%x", editor->cursor_low, editor->cursor_size);
         }
 
-        putchar('\n');
+        screen_putchar('\n');
     }
 }
@@ -17,6 +17,10 @@ typedef struct hexedit_struct {
     int cursor_data_width;
     int esc_state;
     int hex_nybble;
+
+    // Optional, called before the first change to the buffer shown; may
+    // swap in a writable one, or return false to drop the change
+    bool (*modify)(struct hexedit_struct *editor);
 } hexedit_t;
 
 void hexedit_init(hexedit_t* editor, uint8_t* buffer, uint32_t size);
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <irq.h>
+#include <system.h>
+#include <generated/csr.h>
+
+#include "sdemu.h"
+#include "hot.h"
+
+#ifdef HOT_SRAM
+// From linker-hot.ld
+extern char _fhot[], _ehot[], _fhot_load[];
+#endif
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t count;
+} hot_stats_t;
+
+
+void hot_init(void)
+{
+#ifdef HOT_SRAM
+    memcpy(_fhot, _fhot_load, _ehot - _fhot);
+    flush_cpu_icache();
+#endif
+}
+
+static uint32_t hot_now(void)
+{
+    sdtimer_capture_write(0);
+    return sdtimer_capture_ts_read();
+}
+
+static void hot_stats_add(hot_stats_t *s, uint32_t cycles)
+{
+    if (cycles < s->min) s->min = cycles;
+    if (cycles > s->max) s->max = cycles;
+    s->sum += cycles;
+    s->count++;
+}
+
+static void hot_stats_print(const char *label, const hot_stats_t *s)
+{
+    printf("  %s: %u / %u / %u cycles\n", label,
+        (unsigned) s->min, (unsigned) (s->sum / s->count), (unsigned) s->max);
+}
+
+// Every cache flushed and then warm, 'rounds' times each
+static void hot_time(hot_stats_t *cold, hot_stats_t *warm, uint32_t overhead,
+    void (*fn)(uint32_t), uint32_t arg, unsigned rounds)
+{
+    for (unsigned i = 0; i < rounds; i++) {
+        uint32_t t;
+
+        flush_cpu_icache();
+        flush_cpu_dcache();
+        flush_l2_cache();
+        t = hot_now();
+        fn(arg);
+        hot_stats_add(cold, hot_now() - t - overhead);
+
+        t = hot_now();
+        fn(arg);
+        hot_stats_add(warm, hot_now() - t - overhead);
+    }
+}
+
+static void hot_dispatch(uint32_t arg)
+{
+    HOT_FAR(sdemu_isr)();
+}
+
+static void hot_block_read(uint32_t lba)
+{
+    static uint8_t buf[BLOCK_SIZE];
+
+    block_read(buf, lba);
+}
+
+void hot_benchmark(uint32_t lba, unsigned rounds)
+{
+    hot_stats_t isr_cold = { .min = (uint32_t) -1 }, isr_warm = { .min = (uint32_t) -1 };
+    hot_stats_t read_cold = { .min = (uint32_t) -1 }, read_warm = { .min = (uint32_t) -1 };
+    uint32_t overhead = (uint32_t) -1;
+    unsigned int ie = irq_getie();
+
+    if (!rounds) {
+        return;
+    }
+    irq_setie(0);
+
+    // Reading the timer costs a CSR write and a read
+    for (unsigned i = 0; i < rounds; i++) {
+        uint32_t t = hot_now();
+        t = hot_now() - t;
+        if (t < overhead) overhead = t;
+    }
+
+    hot_time(&isr_cold, &isr_warm, overhead, hot_dispatch, 0, rounds);
+    hot_time(&read_cold, &read_warm, overhead, hot_block_read, lba, rounds);
+
+    irq_setie(ie);
+
+#ifdef HOT_SRAM
+    printf("SD interrupt, hot path in SRAM (%u bytes), min / mean / max:\n",
+        (unsigned) (_ehot - _fhot));
+#else
+    printf("SD interrupt, all in SDRAM, min / mean / max:\n");
+#endif
+    hot_stats_print("dispatch, cold caches", &isr_cold);
+    hot_stats_print("dispatch, warm caches", &isr_warm);
+    printf("block_read(%u), in SDRAM either way:\n", (unsigned) lba);
+    hot_stats_print("cold caches", &read_cold);
+    hot_stats_print("warm caches", &read_warm);
+}
@@ -0,0 +1,49 @@
+// Code and data for the SD interrupt's hot path, in on-chip SRAM
+
+#ifndef _HOT_H
+#define _HOT_H
+
+#include <stdint.h>
+
+// Apps link with linker-sdram.ld, so everything runs from SDRAM through
+// the lm32 caches, and a miss after something like a long status print
+// delays the block the victim is waiting for. Built with HOT_SRAM=1
+// (common.mak), HOT_TEXT functions and HOT_DATA variables go in the SoC's
+// integrated SRAM instead, which the app has to itself once the BIOS has
+// jumped to it. hot_init() copies them there; sdemu_init() calls it.
+//
+// SRAM and SDRAM are further apart than a direct call reaches, so calls
+// between the two go through a register: HOT_FAR(block_read)(buf, lba).
+// Hot code may call other hot functions and static inlines directly, but
+// nothing else; the linker refuses with "relocation truncated to fit".
+// Anything that could turn into a memcpy() call, like a struct copy,
+// counts.
+
+#ifdef HOT_SRAM
+#define HOT_TEXT    __attribute__((section(".hot.text"), noinline))
+#define HOT_DATA    __attribute__((section(".hot.data")))
+#else
+#define HOT_TEXT
+#define HOT_DATA
+#endif
+
+static inline void *hot_far_ptr(void *fn)
+{
+    // Hides the address, so the compiler can't make it a direct call
+    __asm__ ("" : "+r" (fn));
+    return fn;
+}
+
+#define HOT_FAR(fn)     ((__typeof__(&(fn))) hot_far_ptr((void *) &(fn)))
+
+void hot_init(void);
+
+// Prints how many cycles sdemu_isr() takes to dispatch, which is what
+// HOT_SRAM moves, and for reference block_read() of 'lba', which stays in
+// SDRAM. Each is the lowest, mean and highest over 'rounds', with every
+// cache flushed first and then again straight after. Interrupts are off
+// meanwhile. Call it before the victim is up: a pending SD event would be
+// served, and timed with the dispatch.
+void hot_benchmark(uint32_t lba, unsigned rounds);
+
+#endif // _HOT_H
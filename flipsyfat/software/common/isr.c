@@ -2,18 +2,40 @@
 #include <irq.h>
 #include <uart.h>
 #include "sdemu.h"
+#include "hot.h"
+#include "isr.h"
 
 void isr(void);
 
+volatile uint32_t isr_busy_cycles;
+
+// SD events first, always: the victim is waiting on those. The UART runs
+// with its own interrupt masked and the rest enabled, so a block request
+// can still get in while it works. crt0 keeps ea on the stack, so the lm32
+// can take one interrupt inside another. Whatever either leaves for later
+// goes through bh.h to the main loop.
 void isr(void)
 {
     unsigned int irqs;
-    
+    uint32_t start;
+
+    sdtimer_capture_write(0);
+    start = sdtimer_capture_ts_read();
     irqs = irq_pending() & irq_getmask();
 
-    if (irqs & (1 << UART_INTERRUPT))
+    if (irqs & (1 << SDEMU_INTERRUPT))
+        HOT_FAR(sdemu_isr)();
+
+    if (irqs & (1 << UART_INTERRUPT)) {
+        unsigned int mask = irq_getmask();
+        irq_setmask(mask & ~(1 << UART_INTERRUPT));
+        irq_setie(1);
         uart_isr();
+        irq_setie(0);
+        irq_setmask(mask);
+    }
 
-    if (irqs & (1 << SDEMU_INTERRUPT))
-        sdemu_isr();
+    // Nested time counts twice; it's a share, not an account
+    sdtimer_capture_write(0);
+    isr_busy_cycles += sdtimer_capture_ts_read() - start;
 }
@@ -0,0 +1,9 @@
+#ifndef _ISR_H
+#define _ISR_H
+
+#include <stdint.h>
+
+// sdtimer cycles spent in isr(), wrapping; for the time share
+extern volatile uint32_t isr_busy_cycles;
+
+#endif // _ISR_H
@@ -0,0 +1,102 @@
+// Append-only log of everything the host writes to the card
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "journal.h"
+#include "sdram.h"
+
+static journal_record_t *ring;
+static uint32_t ring_size;
+static volatile uint32_t ring_head;     // Written by the interrupt
+static volatile uint32_t ring_tail;     // Written by the main loop
+static volatile uint32_t next_seq;
+static volatile uint32_t dropped;
+
+
+bool journal_init(uint32_t num_records)
+{
+    ring = sdram_alloc(num_records * sizeof *ring);
+    ring_size = ring ? num_records : 0;
+    return ring != 0;
+}
+
+static journal_record_t *append(uint32_t type)
+{
+    journal_record_t *rec;
+    uint32_t seq = next_seq++;
+
+    if (!ring_size || ring_head - ring_tail >= ring_size) {
+        dropped++;
+        return 0;
+    }
+
+    rec = &ring[ring_head % ring_size];
+    rec->type = type;
+    rec->seq = seq;
+    return rec;
+}
+
+static void publish(void)
+{
+    // Record contents before the head moves
+    __asm__ volatile("" ::: "memory");
+    ring_head++;
+}
+
+void journal_write(uint32_t lba, uint32_t timestamp, const uint8_t *data)
+{
+    journal_record_t *rec = append(JOURNAL_WRITE);
+
+    if (rec) {
+        rec->lba = lba;
+        rec->last = lba;
+        rec->timestamp = timestamp;
+        memcpy(rec->data, data, sizeof rec->data);
+        publish();
+    }
+}
+
+void journal_discard(uint32_t first, uint32_t last, uint32_t timestamp)
+{
+    journal_record_t *rec = append(JOURNAL_DISCARD);
+
+    if (rec) {
+        rec->lba = first;
+        rec->last = last;
+        rec->timestamp = timestamp;
+        publish();
+    }
+}
+
+void journal_drain(void)
+{
+    uint32_t count = 0;
+
+    while (ring_tail != ring_head) {
+        journal_record_t *rec = &ring[ring_tail % ring_size];
+
+        if (rec->type == JOURNAL_WRITE) {
+            printf("JOURNAL W %u %08x %08x ", rec->seq, rec->lba, rec->timestamp);
+            for (int i = 0; i < sizeof rec->data; i++) {
+                printf("%02x", rec->data[i]);
+            }
+            printf("\n");
+        } else {
+            printf("JOURNAL D %u %08x %08x %08x\n", rec->seq, rec->lba, rec->last, rec->timestamp);
+        }
+
+        __asm__ volatile("" ::: "memory");
+        ring_tail++;
+        count++;
+    }
+
+    printf("JOURNAL end %u %u\n", count, dropped);
+}
+
+int journal_format_status(char *buf, int size)
+{
+    return snprintf(buf, size, "journal:%u/%u seq:%u dropped:%u",
+        ring_head - ring_tail, ring_size, next_seq, dropped);
+}
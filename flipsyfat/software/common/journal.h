@@ -0,0 +1,43 @@
+// Append-only log of everything the host writes to the card
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The SD interrupt appends, the main loop drains. When the ring is full,
+// new records are dropped and counted rather than overwriting old ones.
+//
+// journal_drain() prints one line per record:
+//
+//   JOURNAL W <seq> <lba> <write_ts> <512 bytes of hex>
+//   JOURNAL D <seq> <first lba> <last lba> <timestamp>
+//
+// followed by "JOURNAL end <records> <dropped>". Sequence numbers count
+// every record, including dropped ones, so gaps show where data was lost.
+
+#define JOURNAL_WRITE       'W'
+#define JOURNAL_DISCARD     'D'
+#define JOURNAL_STATUS_LEN  64
+#define JOURNAL_RECORDS     512
+
+typedef struct {
+    uint32_t type;
+    uint32_t seq;
+    uint32_t lba;           // First block
+    uint32_t last;          // Last block, same as lba for writes
+    uint32_t timestamp;     // SDTimer counter
+    uint8_t data[512];      // Writes only
+} journal_record_t;
+
+// Allocates the ring with sdram_alloc; false if there isn't room
+bool journal_init(uint32_t num_records);
+
+void journal_write(uint32_t lba, uint32_t timestamp, const uint8_t *data);
+void journal_discard(uint32_t first, uint32_t last, uint32_t timestamp);
+
+void journal_drain(void);
+int journal_format_status(char *buf, int size);
+
+#endif // _JOURNAL_H
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <time.h>
+#include <generated/csr.h>
+
+#include "reset.h"
+
+#ifdef RESET_HAS_SEQUENCER
+
+void reset_start(uint32_t high_len)
+{
+    reset_wait();
+    clkout_div_write(RESET_CLKOUT_DIV);
+    resetseq_low_len_write(RESET_LOW_LEN);
+    resetseq_high_len_write(high_len);
+    resetseq_start_write(1);
+}
+
+bool reset_busy(void)
+{
+    return resetseq_busy_read();
+}
+
+uint32_t reset_count(void)
+{
+    return resetseq_count_read();
+}
+
+uint32_t reset_timestamp(void)
+{
+    return resetseq_ts_read();
+}
+
+bool reset_auto(bool enable, uint32_t lba)
+{
+    clkout_div_write(RESET_CLKOUT_DIV);
+    resetseq_low_len_write(RESET_LOW_LEN);
+    resetseq_auto_lba_write(lba);
+    resetseq_auto_write(enable);
+    return true;
+}
+
+#else
+
+static uint32_t count;
+static uint32_t timestamp;
+
+void reset_start(uint32_t high_len)
+{
+    int ts = 0;
+    elapsed(&ts, -1);
+
+    // Hold SD emulator in reset
+    sdemu_reset_write(1);
+
+    // Drive reset low, stop clock
+    gpio_out_write(gpio_out_read() & ~RESET_GPIO_MASK);
+    gpio_oe_write(gpio_oe_read() | RESET_GPIO_MASK);
+    clkout_div_write(0);
+    while (!elapsed(&ts, RESET_LOW_LEN));
+
+    // Start clock, emulator, release reset
+    clkout_div_write(RESET_CLKOUT_DIV);
+    sdemu_reset_write(0);
+    gpio_oe_write(gpio_oe_read() & ~RESET_GPIO_MASK);
+
+    if (high_len) {
+        while (!elapsed(&ts, high_len));
+    }
+    sdtimer_capture_write(0);
+    timestamp = sdtimer_capture_ts_read();
+    count++;
+}
+
+bool reset_busy(void)
+{
+    return false;
+}
+
+uint32_t reset_count(void)
+{
+    return count;
+}
+
+uint32_t reset_timestamp(void)
+{
+    return timestamp;
+}
+
+bool reset_auto(bool enable, uint32_t lba)
+{
+    return !enable;
+}
+
+#endif
+
+void reset_wait(void)
+{
+    while (reset_busy());
+}
@@ -0,0 +1,37 @@
+#ifndef _RESET_H
+#define _RESET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <generated/csr.h>
+
+// Victim reset: the SD emulator held in reset, the victim's reset line
+// (gpio 0) low and its clock stopped, then everything released. With the
+// resetseq core the gateware times the sequence; without it the CPU
+// busy-waits through the same steps.
+
+#define RESET_GPIO_MASK     (1 << 0)
+#define RESET_CLKOUT_DIV    16
+#define RESET_LOW_LEN       (CONFIG_CLOCK_FREQUENCY / 10)
+
+#ifdef CSR_RESETSEQ_BASE
+#define RESET_HAS_SEQUENCER
+#endif
+
+// Starts a reset, then after another 'high_len' cycles with the victim
+// running takes a timestamp. Returns right away with the sequencer,
+// otherwise once the sequence is over.
+void reset_start(uint32_t high_len);
+bool reset_busy(void);
+void reset_wait(void);
+
+// Sequences finished, and the sdtimer timestamp at the end of the last
+uint32_t reset_count(void);
+uint32_t reset_timestamp(void);
+
+// Have the sequencer start by itself once the victim has read block 'lba'.
+// Sequences it starts wait as long as the last reset_start() asked for.
+// Returns false if there's no sequencer to do that.
+bool reset_auto(bool enable, uint32_t lba);
+
+#endif // _RESET_H
@@ -0,0 +1,113 @@
+// Single-producer, single-consumer rings between the SD interrupt and the main loop
+
+#ifndef _RING_H
+#define _RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Indices are free-running 32-bit counters: head counts items ever pushed,
+// tail items ever popped. head - tail is the fill level even across the
+// wrap, and each index has exactly one writer, so every shared access is a
+// single word load or store and neither side needs interrupts disabled.
+//
+// RING_DEFINE(name, type, size) declares name_t, holding 'size' items of
+// 'type' (a power of two), and these functions:
+//
+//   name_init                  empty the ring; neither side may be using it
+//   name_count, name_space     items readable, slots writable
+//   name_slot, name_commit     producer: fill slots in place, then publish n
+//   name_peek, name_release    consumer: use items in place, then free n
+//   name_push, name_pop        copy one item in or out; false if full/empty
+//   name_push_batch,
+//   name_pop_batch             copy up to n items; returns how many
+
+// Single core: the interrupt sees memory in program order, so only the
+// compiler needs to be kept from moving item accesses across index updates.
+#ifndef RING_BARRIER
+#define RING_BARRIER()  __asm__ volatile("" ::: "memory")
+#endif
+
+#define RING_DEFINE(name, type, size)                                               \
+                                                                                    \
+_Static_assert(((size) & ((size) - 1)) == 0, #name " size must be a power of two"); \
+                                                                                    \
+typedef struct {                                                                    \
+    volatile uint32_t head;     /* Written by the producer only */                  \
+    volatile uint32_t tail;     /* Written by the consumer only */                  \
+    type items[size];                                                               \
+} name##_t;                                                                         \
+                                                                                    \
+static inline void name##_init(name##_t *r)                                         \
+{                                                                                   \
+    r->head = 0;                                                                    \
+    r->tail = 0;                                                                    \
+}                                                                                   \
+                                                                                    \
+static inline uint32_t name##_count(const name##_t *r)                              \
+{                                                                                   \
+    uint32_t n = r->head - r->tail;                                                 \
+    RING_BARRIER();                                                                 \
+    return n;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline uint32_t name##_space(const name##_t *r)                              \
+{                                                                                   \
+    return (size) - name##_count(r);                                                \
+}                                                                                   \
+                                                                                    \
+static inline type *name##_slot(name##_t *r, uint32_t i)                            \
+{                                                                                   \
+    return &r->items[(r->head + i) & ((size) - 1)];                                 \
+}                                                                                   \
+                                                                                    \
+static inline void name##_commit(name##_t *r, uint32_t n)                           \
+{                                                                                   \
+    RING_BARRIER();                                                                 \
+    r->head += n;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline type *name##_peek(name##_t *r, uint32_t i)                            \
+{                                                                                   \
+    return &r->items[(r->tail + i) & ((size) - 1)];                                 \
+}                                                                                   \
+                                                                                    \
+static inline void name##_release(name##_t *r, uint32_t n)                          \
+{                                                                                   \
+    RING_BARRIER();                                                                 \
+    r->tail += n;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline uint32_t name##_push_batch(name##_t *r, const type *items, uint32_t n) \
+{                                                                                   \
+    uint32_t space = name##_space(r);                                               \
+    if (n > space) n = space;                                                       \
+    for (uint32_t i = 0; i < n; i++) {                                              \
+        *name##_slot(r, i) = items[i];                                              \
+    }                                                                               \
+    name##_commit(r, n);                                                            \
+    return n;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline uint32_t name##_pop_batch(name##_t *r, type *items, uint32_t n)       \
+{                                                                                   \
+    uint32_t count = name##_count(r);                                               \
+    if (n > count) n = count;                                                       \
+    for (uint32_t i = 0; i < n; i++) {                                              \
+        items[i] = *name##_peek(r, i);                                              \
+    }                                                                               \
+    name##_release(r, n);                                                           \
+    return n;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline bool name##_push(name##_t *r, const type *item)                       \
+{                                                                                   \
+    return name##_push_batch(r, item, 1) == 1;                                      \
+}                                                                                   \
+                                                                                    \
+static inline bool name##_pop(name##_t *r, type *item)                              \
+{                                                                                   \
+    return name##_pop_batch(r, item, 1) == 1;                                       \
+}
+
+#endif // _RING_H
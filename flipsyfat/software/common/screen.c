@@ -0,0 +1,130 @@
+// Shadow-screen terminal output
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <generated/csr.h>
+#include "screen.h"
+
+static char frame[SCREEN_ROWS][SCREEN_COLS];
+static char shown[SCREEN_ROWS][SCREEN_COLS];
+static int frame_row, frame_col, frame_rows;
+static int shown_rows;
+static bool shown_valid = false;
+static int last_repaint = 0;
+
+
+void screen_begin(void)
+{
+    memset(frame, ' ', sizeof frame);
+    frame_row = 0;
+    frame_col = 0;
+    frame_rows = 0;
+}
+
+void screen_putchar(char c)
+{
+    if (c == '\n') {
+        frame_row++;
+        frame_col = 0;
+        return;
+    }
+
+    if (frame_col == SCREEN_COLS) {
+        // Wrap long lines
+        frame_row++;
+        frame_col = 0;
+    }
+
+    if (frame_row < SCREEN_ROWS) {
+        frame[frame_row][frame_col++] = c;
+        if (frame_row >= frame_rows) {
+            frame_rows = frame_row + 1;
+        }
+    }
+}
+
+void screen_printf(const char *fmt, ...)
+{
+    char buf[SCREEN_COLS * 4];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+
+    for (char *p = buf; *p; p++) {
+        screen_putchar(*p);
+    }
+}
+
+void screen_invalidate(void)
+{
+    shown_valid = false;
+}
+
+static void screen_repaint(int rows)
+{
+    printf("\e[H\e[J");
+
+    for (int y = 0; y < rows; y++) {
+        int len = SCREEN_COLS;
+        while (len && frame[y][len - 1] == ' ') {
+            len--;
+        }
+        printf("%.*s\n", len, frame[y]);
+    }
+
+    memcpy(shown, frame, sizeof shown);
+    shown_valid = true;
+    elapsed(&last_repaint, -1);
+}
+
+static bool screen_update(int rows)
+{
+    bool sent = false;
+
+    for (int y = 0; y < rows; y++) {
+        int x = 0;
+        while (x < SCREEN_COLS) {
+            if (frame[y][x] == shown[y][x]) {
+                x++;
+                continue;
+            }
+
+            // Extend the span across short unchanged runs
+            int end = x + 1;
+            for (int i = end, same = 0; i < SCREEN_COLS && same < SCREEN_SPAN_GAP; i++) {
+                if (frame[y][i] == shown[y][i]) {
+                    same++;
+                } else {
+                    same = 0;
+                    end = i + 1;
+                }
+            }
+
+            printf("\e[%d;%dH%.*s", y + 1, x + 1, end - x, &frame[y][x]);
+            memcpy(&shown[y][x], &frame[y][x], end - x);
+            sent = true;
+            x = end;
+        }
+    }
+
+    return sent;
+}
+
+void screen_flush(void)
+{
+    int rows = frame_rows > shown_rows ? frame_rows : shown_rows;
+
+    if (!shown_valid || elapsed(&last_repaint, SCREEN_REPAINT_PERIOD)) {
+        screen_repaint(rows);
+    } else if (!screen_update(rows)) {
+        return;
+    }
+
+    // Park the cursor below the frame, for anything printed directly
+    shown_rows = frame_rows;
+    printf("\e[%d;1H", (frame_row < SCREEN_ROWS ? frame_row : SCREEN_ROWS - 1) + 1);
+}
@@ -0,0 +1,23 @@
+// Shadow-screen terminal output
+
+#ifndef _SCREEN_H
+#define _SCREEN_H
+
+#include <stdbool.h>
+
+// Frames are composed into a text buffer, then only the cells that changed
+// since the last flush are sent, using cursor addressing. The whole screen
+// is repainted occasionally, or on request, to recover from line noise.
+
+#define SCREEN_ROWS             96
+#define SCREEN_COLS             120
+#define SCREEN_SPAN_GAP         6       // Unchanged cells cheaper to resend than a new escape
+#define SCREEN_REPAINT_PERIOD   (CONFIG_CLOCK_FREQUENCY * 10)
+
+void screen_begin(void);
+void screen_putchar(char c);
+void screen_printf(const char *fmt, ...);
+void screen_flush(void);
+void screen_invalidate(void);
+
+#endif // _SCREEN_H
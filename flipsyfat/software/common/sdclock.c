@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <generated/csr.h>
+
+#include "sdclock.h"
+
+#ifdef SDCLOCK_HAS_MONITOR
+
+static uint32_t changes_seen;
+
+static uint32_t edges_to_khz(uint32_t edges)
+{
+    return (uint64_t) edges * (CONFIG_CLOCK_FREQUENCY / 1000) / SDCLOCK_WINDOW;
+}
+
+void sdclock_init(void)
+{
+    sdclk_window_write(SDCLOCK_WINDOW);
+    sdclk_tolerance_write(SDCLOCK_TOLERANCE);
+    sdclk_stable_write(SDCLOCK_STABLE);
+    changes_seen = 0;
+}
+
+void sdclock_read(sdclock_t *clock)
+{
+    clock->khz = edges_to_khz(sdclk_edges_read());
+    clock->period_min = sdclk_period_min_read();
+    clock->period_max = sdclk_period_max_read();
+    clock->ts = 0;
+}
+
+bool sdclock_changed(sdclock_t *change)
+{
+    uint32_t count = sdclk_change_count_read();
+
+    if (count == changes_seen) {
+        return false;
+    }
+    changes_seen = count;
+
+    // Periods from the latest window, the change may be some windows back
+    sdclock_read(change);
+    change->khz = edges_to_khz(sdclk_change_edges_read());
+    change->ts = sdclk_change_ts_read();
+    return true;
+}
+
+#else
+
+void sdclock_init(void)
+{
+}
+
+void sdclock_read(sdclock_t *clock)
+{
+    memset(clock, 0, sizeof *clock);
+}
+
+bool sdclock_changed(sdclock_t *change)
+{
+    return false;
+}
+
+#endif // SDCLOCK_HAS_MONITOR
@@ -0,0 +1,57 @@
+#ifndef _SDCLOCK_H
+#define _SDCLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <generated/csr.h>
+
+// The host's SD clock, as the sdclk core measures it against ours. Every
+// window it counts clock edges and the shortest and longest period. Windows
+// the clock ran steadily through are full; once SDCLOCK_STABLE full ones in
+// a row differ from the last reference by more than a fraction of it, that
+// is a speed change, timestamped on the sdtimer at the first of them.
+// Without the core nothing is ever measured and no change reported.
+
+#ifdef CSR_SDCLK_BASE
+#define SDCLOCK_HAS_MONITOR
+#endif
+
+// A millisecond window measures to the kHz; changes are over 1/64 and
+// last 4 ms
+#define SDCLOCK_WINDOW      (CONFIG_CLOCK_FREQUENCY / 1000)
+#define SDCLOCK_TOLERANCE   6
+#define SDCLOCK_STABLE      4
+
+// Hosts identify a card at 400 kHz at most before switching to the speed
+// they transfer data at, so every victim reset goes through that
+#define SDCLOCK_INIT_KHZ    400
+
+typedef struct {
+    uint32_t khz;               // 0 when stopped or not measured
+    uint32_t period_min;        // System cycles, shortest and longest
+    uint32_t period_max;
+    uint32_t ts;                // For changes, sdtimer when noticed
+} sdclock_t;
+
+void sdclock_init(void);
+
+// The last window
+void sdclock_read(sdclock_t *clock);
+
+// A speed change since the last call, or the first speed seen
+bool sdclock_changed(sdclock_t *change);
+
+// Within the tolerance of each other
+static inline bool sdclock_same_speed(uint32_t khz, uint32_t reference_khz)
+{
+    uint32_t difference = khz > reference_khz ? khz - reference_khz : reference_khz - khz;
+    return difference <= reference_khz >> SDCLOCK_TOLERANCE;
+}
+
+// The speed of card identification, not of data transfer
+static inline bool sdclock_init_speed(uint32_t khz)
+{
+    return khz <= SDCLOCK_INIT_KHZ + (SDCLOCK_INIT_KHZ >> SDCLOCK_TOLERANCE);
+}
+
+#endif // _SDCLOCK_H
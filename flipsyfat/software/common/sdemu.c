@@ -5,48 +5,193 @@
 #include <generated/csr.h>
 #include <generated/mem.h>
 #include "sdemu.h"
+#include "hot.h"
+#include "bh.h"
 
-static uint32_t sdemu_read_count = 0;
-static uint32_t sdemu_write_count = 0;
+static uint32_t sdemu_read_count HOT_DATA = 0;
+static uint32_t sdemu_write_count HOT_DATA = 0;
+static uint32_t sdemu_erase_count HOT_DATA = 0;
+static uint32_t sdemu_prefetch_count HOT_DATA = 0;
+
+bool sdemu_prefetching HOT_DATA = false;
+
+// The rest of an accepted, journaled erase, waiting for the main loop.
+// Nothing waits on its acknowledgment, so it can, unless the victim
+// touches the range first. Big ones go a chunk of work at a time.
+#define SDEMU_ERASE_CHUNK   64
+static bool erase_deferred HOT_DATA = false;
+static uint32_t erase_first HOT_DATA;
+static uint32_t erase_last HOT_DATA;
+static uint32_t erase_pos HOT_DATA;
+
+static uint32_t no_prefetch_first HOT_DATA = 1;
+static uint32_t no_prefetch_last HOT_DATA = 0;
 
 
 void sdemu_init(void)
 {
+    hot_init();
     sdemu_reset_write(1);
-    sdemu_ev_enable_write(SDEMU_EV_READ | SDEMU_EV_WRITE);
+#ifdef SDEMU_HAS_SYNTH
+    sdemu_synth_enable_write(0);
+#endif
+    sdemu_ev_enable_write(SDEMU_EV_READ | SDEMU_EV_WRITE | SDEMU_EV_FREE | SDEMU_EV_ERASE);
     irq_setmask(irq_getmask() | (1 << SDEMU_INTERRUPT));
     sdemu_reset_write(0);
 }
 
-void sdemu_isr(void)
+void sdemu_no_prefetch(uint32_t first, uint32_t last)
+{
+    unsigned int ie = irq_getie();
+
+    irq_setie(0);
+    no_prefetch_first = first;
+    no_prefetch_last = last;
+    irq_setie(ie);
+}
+
+// With interrupts off, from the handler or the main loop: up to 'count'
+// more of the deferred erase
+static void sdemu_erase_some(uint32_t count)
+{
+    if (block_erase_more(erase_first, erase_last, &erase_pos, count)) {
+        erase_deferred = false;
+        sdemu_erase_count++;
+    }
+}
+
+static void sdemu_erase_now(void)
+{
+    sdemu_erase_some((uint32_t) -1);
+}
+
+// A chunk at a time, so the handler gets in between
+static void sdemu_erase_bh(uint32_t arg)
+{
+    unsigned int ie = irq_getie();
+
+    while (erase_deferred) {
+        irq_setie(0);
+        if (erase_deferred) {
+            sdemu_erase_some(SDEMU_ERASE_CHUNK);
+        }
+        irq_setie(ie);
+    }
+}
+
+// Before anything in the range, which has to see the erase done
+HOT_TEXT static void sdemu_erase_before(uint32_t lba)
+{
+    if (erase_deferred && lba >= erase_first && lba <= erase_last) {
+        HOT_FAR(sdemu_erase_now)();
+    }
+}
+
+HOT_TEXT void sdemu_isr(void)
 {
     unsigned int stat;
 
     stat = sdemu_ev_pending_read();
 
+    if (stat & SDEMU_EV_FREE) {
+        // Multi-block read in progress, fill the idle buffer with the next block.
+        // Acknowledge first; a hit on this prefetch may free the other buffer.
+        uint32_t addr = sdemu_prefetch_hint_read();
+        bool ahead = addr < no_prefetch_first || addr > no_prefetch_last;
+        sdemu_ev_pending_write(SDEMU_EV_FREE);
+#ifdef SDEMU_HAS_SYNTH
+        // No use preparing a block the hardware will generate anyway
+        ahead = ahead && !sdemu_synth_covers(addr);
+#endif
+        if (ahead) {
+            sdemu_erase_before(addr);
+            sdemu_prefetching = true;
+            HOT_FAR(block_read)(SDEMU_RD_BUFFER(!sdemu_read_bank_read()), addr);
+            sdemu_prefetching = false;
+            sdemu_prefetch_addr_write(addr);
+            sdemu_prefetch_commit_write(0);
+            sdemu_prefetch_count++;
+        }
+    }
+
     if (stat & SDEMU_EV_READ) {
-        uint32_t addr = sdemu_read_addr_read();
-        block_read((uint8_t *) SDEMU_BASE, addr);
+        // If the prefetch above matched, the request is already gone
+        if (sdemu_read_act_read()) {
+            uint32_t addr = sdemu_read_addr_read();
+            sdemu_erase_before(addr);
+            HOT_FAR(block_read)(SDEMU_RD_BUFFER(sdemu_read_bank_read()), addr);
+            sdemu_read_count++;
+        }
         sdemu_ev_pending_write(SDEMU_EV_READ);
-        sdemu_read_count++;
     }
 
     if (stat & SDEMU_EV_WRITE) {
         uint32_t addr = sdemu_write_addr_read();
-        block_write((uint8_t *) (SDEMU_BASE + BLOCK_SIZE), addr);
+        sdemu_erase_before(addr);
+        HOT_FAR(block_write)(SDEMU_WR_BUFFER, addr);
         sdemu_ev_pending_write(SDEMU_EV_WRITE);
         sdemu_write_count++;
     }
+
+    if (stat & SDEMU_EV_ERASE) {
+        // Card has already answered; this is only a notification. The
+        // journal gets one record now, in order with the writes; only the
+        // work on stored blocks waits. One erase at a time.
+        sdemu_ev_pending_write(SDEMU_EV_ERASE);
+        if (erase_deferred) {
+            HOT_FAR(sdemu_erase_now)();
+        }
+        erase_first = sdemu_erase_start_read();
+        erase_last = sdemu_erase_end_read();
+        erase_pos = 0;
+        HOT_FAR(block_erase)(erase_first, erase_last);
+        erase_deferred = true;
+        if (!HOT_FAR(bh_defer)(sdemu_erase_bh, 0)) {
+            HOT_FAR(sdemu_erase_now)();
+        }
+    }
 }
 
-void sdemu_status(void)
+#ifdef SDEMU_HAS_SYNTH
+HOT_TEXT bool sdemu_synth_covers(uint32_t lba)
 {
-    printf("rd:%08x wr:%08x rda:%08x.%x wra:%08x.%x cardstat:%08x info:%04x cmd:%d\n",
+    uint32_t enable = sdemu_synth_enable_read();
+
+    if ((enable & SDEMU_SYNTH_ROOT) &&
+        lba >= sdemu_synth_root_start_read() && lba <= sdemu_synth_root_end_read()) {
+        return true;
+    }
+
+    // Two tables back to back; below the start the offset wraps
+    return (enable & SDEMU_SYNTH_FAT) &&
+        lba - sdemu_synth_fat_start_read() < 2 * sdemu_synth_fat_sectors_read();
+}
+#endif
+
+int sdemu_format_status(char *buf, int size)
+{
+#ifdef SDEMU_HAS_SYNTH
+    uint32_t synth_count = sdemu_synth_count_read();
+#else
+    uint32_t synth_count = 0;
+#endif
+
+    return snprintf(buf, size, "rd:%08x pf:%08x sy:%08x wr:%08x er:%x rda:%08x.%x wra:%08x.%x cardstat:%08x info:%04x cmd:%d",
         sdemu_read_count,
+        sdemu_prefetch_count,
+        synth_count,
         sdemu_write_count,
+        sdemu_erase_count,
         sdemu_read_addr_read(), sdemu_read_byteaddr_read() & 0x1FF,
         sdemu_write_addr_read(), sdemu_write_byteaddr_read() & 0x1FF,
         sdemu_card_status_read(),
         sdemu_info_bits_read(),
         sdemu_most_recent_cmd_read());
 }
+
+void sdemu_status(void)
+{
+    char buf[SDEMU_STATUS_LEN];
+    sdemu_format_status(buf, sizeof buf);
+    printf("%s\n", buf);
+}
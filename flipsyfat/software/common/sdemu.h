@@ -2,18 +2,76 @@
 #define _SDEMU_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <generated/csr.h>
+#include <generated/mem.h>
 
 #define BLOCK_SIZE  512
 
 #define SDEMU_EV_READ   (1 << 0)
 #define SDEMU_EV_WRITE  (1 << 1)
+#define SDEMU_EV_FREE   (1 << 2)
+#define SDEMU_EV_ERASE  (1 << 3)
+
+// Two read buffers (ping-pong) and one write buffer
+#define SDEMU_RD_BUFFER(bank)   ((uint8_t *) (SDEMU_BASE + (bank) * BLOCK_SIZE))
+#define SDEMU_WR_BUFFER         ((uint8_t *) (SDEMU_BASE + 2 * BLOCK_SIZE))
+
+#define SDEMU_STATUS_LEN    144
+
+// Hardware generator for root directory and FAT blocks, when the gateware
+// has it. Templates are one dentry replicated across the root directory,
+// and the volume label in its first entry.
+#ifdef CSR_SDEMU_SYNTH_ENABLE_ADDR
+#define SDEMU_HAS_SYNTH
+#define SDEMU_SYNTH_ROOT        (1 << 0)
+#define SDEMU_SYNTH_FAT         (1 << 1)
+#define SDEMU_SYNTH_TEMPLATE    ((uint8_t *) (SDEMU_BASE + 3 * BLOCK_SIZE))
+#define SDEMU_SYNTH_LABEL       (SDEMU_SYNTH_TEMPLATE + 0x20)
+
+bool sdemu_synth_covers(uint32_t lba);
+#endif
 
 void sdemu_isr(void);
 void sdemu_init(void);
 void sdemu_status(void);
+int sdemu_format_status(char *buf, int size);
+
+// Blocks from 'first' to 'last' are never read ahead, their block_read()
+// waits for the victim's request: for callbacks that time it, or change
+// the block in between. None to begin with.
+void sdemu_no_prefetch(uint32_t first, uint32_t last);
 
 // Callbacks
 void block_read(uint8_t *buf, uint32_t lba);
 void block_write(uint8_t *buf, uint32_t lba);
 
+// An erase comes in two parts. block_erase() runs once, from the handler,
+// as the card accepts it: journal it there, and nothing slow. Then
+// block_erase_more() does the rest a piece at a time, with interrupts off,
+// from 'pos' (0 at first) on and about 'count' units of work. It moves
+// 'pos' along and returns true once the erase is complete. Every read
+// inside the range, and every write inside it, waits for that.
+void block_erase(uint32_t first, uint32_t last);
+bool block_erase_more(uint32_t first, uint32_t last, uint32_t *pos, uint32_t count);
+
+// While block_read() is prefetching, trigger bits apply to the prefetched
+// block and are held until the emulator switches to it. Callbacks should
+// use these instead of writing sdtrig_latch directly.
+extern bool sdemu_prefetching;
+
+static inline uint32_t sdemu_trigger_read(void)
+{
+    return sdemu_prefetching ? sdtrig_latch_next_read() : sdtrig_latch_read();
+}
+
+static inline void sdemu_trigger_write(uint32_t value)
+{
+    if (sdemu_prefetching) {
+        sdtrig_latch_next_write(value);
+    } else {
+        sdtrig_latch_write(value);
+    }
+}
+
 #endif // _SDEMU_H
@@ -0,0 +1,37 @@
+// Bulk storage in main RAM
+
+#include <stdint.h>
+#include <stddef.h>
+#include <generated/mem.h>
+#include "sdram.h"
+
+extern char _ebss[];
+static uintptr_t sdram_next = 0;
+
+
+static void sdram_init(void)
+{
+    if (!sdram_next) {
+        sdram_next = ((uintptr_t)_ebss + SDRAM_ALIGN - 1) & ~(uintptr_t)(SDRAM_ALIGN - 1);
+    }
+}
+
+uint32_t sdram_free_space(void)
+{
+    sdram_init();
+    return MAIN_RAM_BASE + MAIN_RAM_SIZE - SDRAM_STACK_RESERVE - sdram_next;
+}
+
+void *sdram_alloc(uint32_t size)
+{
+    void *p;
+
+    size = (size + SDRAM_ALIGN - 1) & ~(uint32_t)(SDRAM_ALIGN - 1);
+    if (size > sdram_free_space()) {
+        return NULL;
+    }
+
+    p = (void*) sdram_next;
+    sdram_next += size;
+    return p;
+}
@@ -0,0 +1,17 @@
+// Bulk storage in main RAM
+
+#ifndef _SDRAM_H
+#define _SDRAM_H
+
+#include <stdint.h>
+
+// Space between the end of the program image and the stack is handed out
+// in large, never-freed chunks for block stores and tables.
+
+#define SDRAM_STACK_RESERVE     0x10000
+#define SDRAM_ALIGN             32
+
+void *sdram_alloc(uint32_t size);
+uint32_t sdram_free_space(void);
+
+#endif // _SDRAM_H
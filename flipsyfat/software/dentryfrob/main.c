@@ -15,37 +15,33 @@
 #include "sdemu.h"
 #include "fat.h"
 #include "hexedit.h"
+#include "screen.h"
+#include "sweep.h"
+#include "journal.h"
+#include "bh.h"
+#include "reset.h"
 
 static uint8_t guess[FAT_DENTRY_SIZE];
 static int num_files = FAT_MAX_ROOT_ENTRIES - 1;
 static bool auto_advance = false;
 
-#define NORMAL_CLKOUT_DIV 16
-static const uint32_t reset_gpio_mask = 1 << 0;
-static const uint32_t reset_low_len = CONFIG_CLOCK_FREQUENCY / 10;
-
-static void reset_pulse(void)
+void reset_pulse(void)
 {
-    int ts = 0;
-    elapsed(&ts, -1);
-
-    // Hold SD emulator in reset
-    sdemu_reset_write(1);
-
-    // Drive reset low, stop clock
-    gpio_out_write(gpio_out_read() & ~reset_gpio_mask);
-    gpio_oe_write(gpio_oe_read() | reset_gpio_mask);
-    clkout_div_write(0);
-    while (!elapsed(&ts, reset_low_len));
-
-    // Start clock, emulator, release reset
-    clkout_div_write(NORMAL_CLKOUT_DIV);
-    sdemu_reset_write(0);
-    gpio_oe_write(gpio_oe_read() & ~reset_gpio_mask);
+    reset_start(0);
+    reset_wait();
 }
 
-static bool local_interact(char ch)
+static bool local_interact(hexedit_t *editor, char ch)
 {
+    if (sweep_active()) {
+        // Only abort while sweeping; everything else would disturb the field
+        if (ch == 'x') {
+            sweep_abort();
+            screen_invalidate();
+        }
+        return true;
+    }
+
     switch (ch) {
         case 'N':
             num_files++;
@@ -59,6 +55,24 @@ static bool local_interact(char ch)
         case 'R':
             reset_pulse();
             return true;
+        case 'P':
+            sweep_preset = (sweep_preset + 1) % SWEEP_PRESET_COUNT;
+            return true;
+        case 'M':
+            if (sweep_reps < SWEEP_MAX_REPS) sweep_reps++;
+            return true;
+        case 'm':
+            if (sweep_reps > 1) sweep_reps--;
+            return true;
+        case 'J':
+            journal_drain();
+            screen_invalidate();
+            return true;
+        case 'X':
+            // Field is the hex editor's cursor, up to 4 bytes wide
+            auto_advance = false;
+            sweep_start(guess, editor->cursor_low, editor->cursor_size);
+            return true;
     }
     return false;
 }
@@ -71,6 +85,16 @@ int main(void)
     irq_setie(1);
     time_init();
     uart_init();
+    blockmap_init(&fat_overlay, FAT_OVERLAY_BLOCKS);
+    journal_init(JOURNAL_RECORDS);
+
+    // The sweep is the root directory; a copy the victim writes back
+    // would hide every later value
+    fat_overlay_exclude(FAT_ROOT_START, FAT_ROOT_END);
+
+    // Sweep counts and timestamps belong to the victim's request, not to
+    // a read-ahead a block earlier
+    sdemu_no_prefetch(FAT_ROOT_START, FAT_ROOT_END);
     sdemu_init();
 
     reset_pulse();
@@ -87,9 +111,20 @@ int main(void)
         static int auto_advance_ticks = 0;
         bool force_status = false;
 
+        bh_run();
+
         if (uart_read_nonblock()) {
             uint8_t chr = uart_read();
-            force_status |= (editor.esc_state ? 0 : local_interact(chr)) || hexedit_interact(&editor, chr);
+            force_status |= (editor.esc_state ? 0 : local_interact(&editor, chr)) || hexedit_interact(&editor, chr);
+        }
+
+        if (sweep_active()) {
+            // Results go straight to the serial port, no screen in between
+            sweep_poll();
+            if (!sweep_active()) {
+                screen_invalidate();
+            }
+            continue;
         }
 
         // Add-on for the hex editor, automatic advance timer for time-lapse experiments
@@ -105,12 +140,18 @@ int main(void)
         }
 
         if (force_status || elapsed(&last_event, CONFIG_CLOCK_FREQUENCY / 4)) {
-            printf("\e[H"); // Home
-            if (!force_status) printf("\e[J"); // Clear
+            char status[SDEMU_STATUS_LEN];
+            char sweep[SWEEP_STATUS_LEN];
+            char journal[JOURNAL_STATUS_LEN];
+            screen_begin();
             hexedit_print(&editor);
-            printf("\nauto=%02d nfile=%02x\n",
-                auto_advance ? auto_advance_ticks : 0, num_files);
-            sdemu_status();
+            sweep_format_status(sweep, sizeof sweep);
+            screen_printf("\nauto=%02d nfile=%02x %s\n",
+                auto_advance ? auto_advance_ticks : 0, num_files, sweep);
+            sdemu_format_status(status, sizeof status);
+            journal_format_status(journal, sizeof journal);
+            screen_printf("%s\n%s\n", status, journal);
+            screen_flush();
         }
     }
 
@@ -119,6 +160,8 @@ int main(void)
 
 void fat_rootdir_entry(uint8_t* dest, unsigned index)
 {
+    sweep_rootdir_read(index, index > num_files);
+
     if (index == 0) {
         memset(dest, 0, FAT_DENTRY_SIZE);
         fat_volume_label(dest);
@@ -127,12 +170,13 @@ void fat_rootdir_entry(uint8_t* dest, unsigned index)
     } else {
         // Reading end of directory table
         memset(dest, 0, FAT_DENTRY_SIZE);
-        sdtrig_latch_write(sdtrig_latch_read() | 0x10);
+        sdemu_trigger_write(sdemu_trigger_read() | 0x10);
     }
 }
 
 void fat_data_block(uint8_t* dest, unsigned cluster, unsigned index)
 {
+    sweep_data_read();
     memset(dest, 'Z', BLOCK_SIZE); 
     sprintf((char*) dest, "%04x+%x cluster\n", cluster, index);
 }
@@ -0,0 +1,306 @@
+// Sweep a dentry field through a list of values, timing the victim's
+// root directory scan for each one
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <generated/csr.h>
+
+#include "fat.h"
+#include "sweep.h"
+
+// Scan is over when the victim stops reading for a while
+static const uint32_t settle_len = CONFIG_CLOCK_FREQUENCY / 2;
+static const uint32_t timeout_len = CONFIG_CLOCK_FREQUENCY * 4;
+
+static const uint32_t preset_edges[] = {
+    0x00, 0x01, 0x02, 0x7f, 0x80, 0xfe, 0xff,
+    0x100, 0x7fff, 0x8000, 0xffef, 0xfff0, 0xfff6, 0xfff7, 0xfff8, 0xffff,
+    0x10000, 0x0ffffff7, 0x0ffffff8, 0x7fffffff, 0x80000000, 0xffffffff,
+};
+
+static const uint32_t preset_attr[] = {
+    0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+    0x03, 0x06, 0x07, 0x0f, 0x11, 0x18, 0x21, 0x27, 0x3f, 0xff,
+};
+
+static const uint32_t preset_chars_special[] = {
+    0x00, 0x05, 0x2e, 0x7f, 0xe5, 0xff,
+};
+
+static const char *preset_names[SWEEP_PRESET_COUNT] = {
+    "range", "edges", "attr", "chars",
+};
+
+enum {
+    STATE_IDLE,
+    STATE_RESET,
+    STATE_SCAN,
+};
+
+int sweep_preset = SWEEP_PRESET_RANGE;
+int sweep_reps = 4;
+
+static int state = STATE_IDLE;
+static uint8_t *field;
+static unsigned field_offset;
+static unsigned field_width;
+static uint8_t field_saved[SWEEP_MAX_WIDTH];
+static uint32_t range_base;
+static unsigned value_index;
+static unsigned value_count;
+static uint32_t value;
+static int rep;
+static uint32_t reset_ts;
+
+// Written by the SD interrupt during a scan
+static volatile struct {
+    uint32_t first_ts;
+    uint32_t last_ts;
+    uint32_t sectors;
+    uint32_t data_blocks;
+    bool eod;
+} scan;
+
+// Per-value totals
+static struct {
+    uint32_t time_min, time_max;
+    uint64_t time_sum;          // Thousands of scans overflow 32 bits
+    uint32_t sectors_min, sectors_max;
+    uint32_t data_blocks;
+    uint32_t eod;
+    uint32_t timeouts;
+} result;
+
+
+static uint32_t timer_now(void)
+{
+    sdtimer_capture_write(0);
+    return sdtimer_capture_ts_read();
+}
+
+static uint32_t field_mask(void)
+{
+    return field_width >= 4 ? 0xffffffff : (1u << (8 * field_width)) - 1;
+}
+
+static unsigned preset_count(void)
+{
+    switch (sweep_preset) {
+        case SWEEP_PRESET_EDGES:    return sizeof preset_edges / sizeof preset_edges[0];
+        case SWEEP_PRESET_ATTR:     return sizeof preset_attr / sizeof preset_attr[0];
+        case SWEEP_PRESET_CHARS:    return ('~' - ' ' + 1) + sizeof preset_chars_special / sizeof preset_chars_special[0];
+        default:                    return 256;
+    }
+}
+
+// Returns false for list entries that don't fit the field
+static bool preset_value(unsigned index, uint32_t *v)
+{
+    switch (sweep_preset) {
+        case SWEEP_PRESET_EDGES:
+            *v = preset_edges[index];
+            break;
+        case SWEEP_PRESET_ATTR:
+            *v = preset_attr[index];
+            break;
+        case SWEEP_PRESET_CHARS:
+            *v = index <= '~' - ' ' ? ' ' + index : preset_chars_special[index - ('~' - ' ' + 1)];
+            break;
+        default:
+            *v = (range_base + index) & field_mask();
+            return true;
+    }
+    return (*v & ~field_mask()) == 0;
+}
+
+static void field_write(uint32_t v)
+{
+    for (unsigned i = 0; i < field_width; i++) {
+        field[field_offset + i] = v >> (8 * i);
+    }
+}
+
+static uint32_t field_read(void)
+{
+    uint32_t v = 0;
+    for (unsigned i = 0; i < field_width; i++) {
+        v |= field[field_offset + i] << (8 * i);
+    }
+    return v;
+}
+
+// Next value that fits, or false at the end of the list
+static bool next_value(void)
+{
+    while (++value_index < value_count) {
+        if (preset_value(value_index, &value)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void finish(const char *why)
+{
+    memcpy(field + field_offset, field_saved, field_width);
+    state = STATE_IDLE;
+    printf("SWEEP %s\n", why);
+}
+
+static void begin_value(void)
+{
+    memset(&result, 0, sizeof result);
+    result.time_min = result.sectors_min = (uint32_t) -1;
+    field_write(value);
+    rep = 0;
+    state = STATE_RESET;
+}
+
+static void emit_value(void)
+{
+    int n = sweep_reps - result.timeouts;
+
+    printf("SWEEP %02x:%d %08x n=%d t=%u/%u/%u sec=%u-%u data=%u eod=%u tmo=%u\n",
+        field_offset, field_width, (unsigned) value, n,
+        n ? (unsigned) result.time_min : 0,
+        n ? (unsigned) (result.time_sum / n) : 0,
+        (unsigned) result.time_max,
+        n ? (unsigned) result.sectors_min : 0,
+        (unsigned) result.sectors_max,
+        (unsigned) result.data_blocks, (unsigned) result.eod, (unsigned) result.timeouts);
+}
+
+static void end_scan(bool timed_out)
+{
+    if (timed_out) {
+        result.timeouts++;
+    } else {
+        uint32_t t = scan.sectors ? scan.last_ts - scan.first_ts : 0;
+        if (t < result.time_min) result.time_min = t;
+        if (t > result.time_max) result.time_max = t;
+        result.time_sum += t;
+        if (scan.sectors < result.sectors_min) result.sectors_min = scan.sectors;
+        if (scan.sectors > result.sectors_max) result.sectors_max = scan.sectors;
+    }
+    result.data_blocks += scan.data_blocks;
+    result.eod += scan.eod;
+
+    if (++rep < sweep_reps) {
+        state = STATE_RESET;
+        return;
+    }
+
+    emit_value();
+    if (next_value()) {
+        begin_value();
+    } else {
+        finish("done");
+    }
+}
+
+void sweep_start(uint8_t *dentry, unsigned offset, unsigned width)
+{
+    if (state != STATE_IDLE) {
+        return;
+    }
+    if (width > SWEEP_MAX_WIDTH) {
+        width = SWEEP_MAX_WIDTH;
+    }
+    if (offset + width > FAT_DENTRY_SIZE) {
+        width = FAT_DENTRY_SIZE - offset;
+    }
+
+    field = dentry;
+    field_offset = offset;
+    field_width = width;
+    memcpy(field_saved, field + offset, width);
+    range_base = field_read();
+    value_count = preset_count();
+    value_index = 0;
+
+    printf("SWEEP begin off=%02x width=%d preset=%s values=%d reps=%d\n",
+        offset, width, preset_names[sweep_preset], value_count, sweep_reps);
+
+    if (preset_value(0, &value) || next_value()) {
+        begin_value();
+    } else {
+        finish("empty");
+    }
+}
+
+void sweep_abort(void)
+{
+    if (state != STATE_IDLE) {
+        finish("aborted");
+    }
+}
+
+bool sweep_active(void)
+{
+    return state != STATE_IDLE;
+}
+
+void sweep_poll(void)
+{
+    uint32_t now;
+
+    switch (state) {
+
+        case STATE_RESET:
+            memset((void*) &scan, 0, sizeof scan);
+            reset_pulse();
+            reset_ts = timer_now();
+            state = STATE_SCAN;
+            break;
+
+        case STATE_SCAN:
+            now = timer_now();
+            if (scan.sectors && (int32_t)(now - sdtimer_read_ts_read()) > (int32_t)settle_len) {
+                end_scan(false);
+            } else if ((int32_t)(now - reset_ts) > (int32_t)timeout_len) {
+                end_scan(true);
+            }
+            break;
+    }
+}
+
+int sweep_format_status(char *buf, int len)
+{
+    if (state == STATE_IDLE) {
+        return snprintf(buf, len, "sweep idle preset=%s reps=%d",
+            preset_names[sweep_preset], sweep_reps);
+    }
+    return snprintf(buf, len, "sweep %02x:%d preset=%s value %d/%d =%08x rep %d/%d",
+        field_offset, field_width, preset_names[sweep_preset],
+        value_index + 1, value_count, (unsigned) value, rep + 1, sweep_reps);
+}
+
+void sweep_rootdir_read(unsigned index, bool past_end)
+{
+    if (state != STATE_SCAN) {
+        return;
+    }
+
+    if (index % FAT_DENTRY_PER_SECTOR == 0) {
+        // First entry of each root sector
+        scan.last_ts = sdtimer_read_ts_read();
+        if (!scan.sectors) {
+            scan.first_ts = scan.last_ts;
+        }
+        scan.sectors++;
+    }
+
+    if (past_end) {
+        scan.eod = true;
+    }
+}
+
+void sweep_data_read(void)
+{
+    if (state == STATE_SCAN) {
+        scan.data_blocks++;
+    }
+}
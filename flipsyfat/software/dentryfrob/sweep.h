@@ -0,0 +1,47 @@
+// Sweep a dentry field through a list of values, timing the victim's
+// root directory scan for each one
+
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SWEEP_MAX_WIDTH     4
+#define SWEEP_MAX_REPS      64
+#define SWEEP_STATUS_LEN    96
+
+enum {
+    SWEEP_PRESET_RANGE,     // 256 values counting up from the current one
+    SWEEP_PRESET_EDGES,     // Boundary values that fit the field width
+    SWEEP_PRESET_ATTR,      // Attribute bit combinations
+    SWEEP_PRESET_CHARS,     // Name bytes: printable ASCII and FAT specials
+    SWEEP_PRESET_COUNT
+};
+
+extern int sweep_preset;
+extern int sweep_reps;
+
+// Each value gets sweep_reps target resets. Every reset records the time
+// from the first to the last root directory sector read (SDTimer read_ts),
+// the sectors and data blocks read, and whether the scan went past the
+// last file. One "SWEEP" line per value summarizes them:
+//
+//   SWEEP off:width value n=good t=min/avg/max sec=min-max data=N eod=N tmo=N
+//
+// Sweeps 'width' bytes at 'offset' of the dentry, little endian.
+// The original bytes are put back when the sweep ends.
+void sweep_start(uint8_t *dentry, unsigned offset, unsigned width);
+void sweep_abort(void);
+bool sweep_active(void);
+void sweep_poll(void);
+int sweep_format_status(char *buf, int len);
+
+// Called from the FAT callbacks
+void sweep_rootdir_read(unsigned index, bool past_end);
+void sweep_data_read(void);
+
+// Provided by the app
+void reset_pulse(void);
+
+#endif // _SWEEP_H
@@ -14,38 +14,70 @@
 #include "sdemu.h"
 #include "fat.h"
 #include "hexedit.h"
-
-#define FILE_CLUSTER  0x1000
-static const char *file_name = "UP_BM";
-static const char *file_ext = "BIN";
-static uint8_t file_data[0x1000];  // 0x819 seems to be minimum
+#include "screen.h"
+#include "sdram.h"
+#include "upload.h"
+#include "journal.h"
+#include "bh.h"
+#include "reset.h"
+
+#define FILE_CLUSTER        (FAT_CLUSTER_COUNT > 0x2000 ? 0x1000 : 0x100)   // Lower on small volumes
+#define FILE_DEFAULT_SIZE   0x1000      // 0x819 seems to be minimum
+#define FILE_MAX_SIZE       0x800000
+#define FILE_FAT_SPACE      ((FAT_CLUSTER_COUNT + 2 - FILE_CLUSTER) * FAT_CLUSTER_SIZE * BLOCK_SIZE)
+#define FILE_CLUSTER_BYTES  (FAT_CLUSTER_SIZE * BLOCK_SIZE)
+
+static char file_name[9] = "UP_BM";
+static char file_ext[4] = "BIN";
+static uint8_t *file_data;
+static uint32_t file_capacity;
+static uint32_t file_size = FILE_DEFAULT_SIZE;
 static volatile uint32_t file_last_read = -1;
-
-#define NORMAL_CLKOUT_DIV 16
-static const uint32_t reset_gpio_mask = 1 << 0;
-static const uint32_t reset_low_len = CONFIG_CLOCK_FREQUENCY / 10;
+static hexedit_t editor;
 
 static void reset_pulse(void)
 {
-    int ts = 0;
-    elapsed(&ts, -1);
-
     fat_trace_buffer_index = 0;
     file_last_read = -1;
+    reset_start(0);
+    reset_wait();
+}
+
+static void file_layout(void)
+{
+    uint32_t clusters = (file_size + FILE_CLUSTER_BYTES - 1) / FILE_CLUSTER_BYTES;
+
+    fat_chain_first = FILE_CLUSTER;
+    fat_chain_last = FILE_CLUSTER + (clusters ? clusters : 1) - 1;
+    hexedit_init(&editor, file_data, file_size ? file_size : 1);
+}
 
-    // Hold SD emulator in reset
-    sdemu_reset_write(1);
+static void file_init(void)
+{
+    file_capacity = sdram_free_space() & ~(uint32_t)(BLOCK_SIZE - 1);
+    if (file_capacity > FILE_MAX_SIZE) file_capacity = FILE_MAX_SIZE;
+    if (file_capacity > FILE_FAT_SPACE) file_capacity = FILE_FAT_SPACE;
+
+    file_data = sdram_alloc(file_capacity);
+    memset(file_data, 0, FILE_DEFAULT_SIZE);
+    upload_init(file_data, file_capacity);
+    file_layout();
+}
 
-    // Drive reset low, stop clock
-    gpio_out_write(gpio_out_read() & ~reset_gpio_mask);
-    gpio_oe_write(gpio_oe_read() | reset_gpio_mask);
-    clkout_div_write(0);
-    while (!elapsed(&ts, reset_low_len));
+void upload_begin(void)
+{
+    // Card shows an empty file until the new one is complete
+    file_size = 0;
+    file_layout();
+}
 
-    // Start clock, emulator, release reset
-    clkout_div_write(NORMAL_CLKOUT_DIV);
-    sdemu_reset_write(0);
-    gpio_oe_write(gpio_oe_read() & ~reset_gpio_mask);
+void upload_complete(uint32_t size, const char *name, const char *ext)
+{
+    file_size = size;
+    strcpy(file_name, name);
+    strcpy(file_ext, ext);
+    file_layout();
+    reset_pulse();
 }
 
 static bool local_interact(char ch)
@@ -54,20 +86,24 @@ static bool local_interact(char ch)
         case 'R':
             reset_pulse();
             return true;
+        case 'J':
+            journal_drain();
+            screen_invalidate();
+            return true;
     }
     return false;
 }
 
 int main(void)
 {
-    hexedit_t editor;
-
     irq_setmask(0);
     irq_setie(1);
     time_init();
     uart_init();
+    blockmap_init(&fat_overlay, FAT_OVERLAY_BLOCKS);
+    journal_init(JOURNAL_RECORDS);
     sdemu_init();
-    hexedit_init(&editor, file_data, sizeof file_data);
+    file_init();
 
     puts("File editor software built "__DATE__" "__TIME__"\n");
 
@@ -77,39 +113,50 @@ int main(void)
         static int last_event = 0;
         bool force_status = false;
 
+        bh_run();
+
         if (uart_read_nonblock()) {
             uint8_t chr = uart_read();
-            force_status |= (editor.esc_state ? 0 : local_interact(chr)) || hexedit_interact(&editor, chr);
+            if (upload_active() || (chr == UPLOAD_SOH && !editor.esc_state)) {
+                upload_rx(chr);
+            } else {
+                force_status |= (editor.esc_state ? 0 : local_interact(chr)) || hexedit_interact(&editor, chr);
+            }
         }
+        upload_poll();
 
-        if (force_status || elapsed(&last_event, CONFIG_CLOCK_FREQUENCY / 2)) {
-            // Home
-            printf("\e[H");
+        if (upload_active()) {
+            // Serial port belongs to the uploader; redraw everything afterwards
+            screen_invalidate();
+        } else if (force_status || elapsed(&last_event, CONFIG_CLOCK_FREQUENCY / 2)) {
+            char status[SDEMU_STATUS_LEN];
+            char journal[JOURNAL_STATUS_LEN];
+            uint8_t *rd_buf = SDEMU_RD_BUFFER(sdemu_read_bank_read());
 
-            // Clear
-            if (!force_status) printf("\e[J");
+            screen_begin();
+            screen_printf("file=%s.%s size=%08x capacity=%08x last_read=%08x\n",
+                file_name, file_ext, file_size, file_capacity, file_last_read);
 
-            printf("last_read=%08x \n", file_last_read);
-
-            printf("trace [");
+            screen_printf("trace [");
             for (int i = 0; i < fat_trace_buffer_index; i++) {
-                printf(" %x", fat_trace_buffer_block[i]);
+                screen_printf(" %x", fat_trace_buffer_block[i]);
             }
-            printf(" ]\n\n");
-
+            screen_printf(" ]\n\n");
 
             for (int y = 0; y < 0x20; y++) {
-                printf("rd_buf %03x:", y<<4);
+                screen_printf("rd_buf %03x:", y<<4);
                 for (int x = 0; x < 0x10; x++) {
-                    printf(" %02x", *(uint8_t*)(SDEMU_BASE + x + (y<<4)));
+                    screen_printf(" %02x", rd_buf[x + (y<<4)]);
                 }
-                putchar('\n');
+                screen_putchar('\n');
             }
-            putchar('\n');
+            screen_putchar('\n');
 
             hexedit_print(&editor);
-            putchar('\n');
-            sdemu_status();
+            sdemu_format_status(status, sizeof status);
+            journal_format_status(journal, sizeof journal);
+            screen_printf("\n%s\n%s\n", status, journal);
+            screen_flush();
         }
     }
 
@@ -122,7 +169,7 @@ void fat_rootdir_entry(uint8_t* dest, unsigned index)
     if (index == 0) {
         fat_volume_label(dest);
     } else if (index == 1) {
-        fat_plain_file(dest, file_name, file_ext, FILE_CLUSTER, sizeof file_data);
+        fat_plain_file(dest, file_name, file_ext, FILE_CLUSTER, file_size);
     }
 }
 
@@ -131,9 +178,9 @@ void fat_data_block(uint8_t* dest, unsigned cluster, unsigned index)
     index += (cluster - FILE_CLUSTER) * FAT_CLUSTER_SIZE;
     file_last_read = index * BLOCK_SIZE;
         
-    if (index < sizeof file_data / BLOCK_SIZE) {
+    if (index < (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE) {
         memcpy(dest, file_data + index * BLOCK_SIZE, BLOCK_SIZE);
-        sdtrig_latch_write(sdtrig_latch_read() | 0x10);
+        sdemu_trigger_write(sdemu_trigger_read() | 0x10);
     }
     else {
         memset(dest, 'Z', BLOCK_SIZE); 
@@ -0,0 +1,214 @@
+// Binary file upload over the UART
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <uart.h>
+#include <time.h>
+#include <crc.h>
+#include <generated/csr.h>
+
+#include "upload.h"
+
+enum {
+    RX_IDLE,
+    RX_HEADER,
+    RX_PAYLOAD,
+    RX_CRC,
+};
+
+static uint8_t *store;
+static uint32_t store_capacity;
+
+static bool active = false;
+static bool committed = false;      // Last upload ended; its 'E' may come again
+static uint32_t file_size;
+static uint32_t file_blocks;
+static uint32_t next_block;
+static char file_name[9];
+static char file_ext[4];
+
+static int rx_state = RX_IDLE;
+static uint8_t rx_frame[3 + UPLOAD_MAX_PAYLOAD];
+static uint32_t rx_len;
+static uint32_t rx_count;
+static uint8_t rx_crc[4];
+static int rx_last_byte;
+static int rx_last_frame;
+
+
+static uint32_t get_uint32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void reply(uint8_t code)
+{
+    uart_write(code);
+    uart_write(next_block);
+    uart_write(next_block >> 8);
+    uart_write(next_block >> 16);
+    uart_write(next_block >> 24);
+}
+
+static void frame_start(const uint8_t *payload, uint32_t len)
+{
+    if (len != 15) {
+        reply(UPLOAD_NAK);
+        return;
+    }
+
+    committed = false;
+    file_size = get_uint32(payload);
+    file_blocks = (file_size + UPLOAD_BLOCK_SIZE - 1) / UPLOAD_BLOCK_SIZE;
+    if (file_blocks * UPLOAD_BLOCK_SIZE > store_capacity) {
+        // Too big; stay out of upload mode
+        active = false;
+        next_block = 0;
+        reply(UPLOAD_NAK);
+        return;
+    }
+
+    memcpy(file_name, payload + 4, 8);
+    memcpy(file_ext, payload + 12, 3);
+    file_name[8] = '\0';
+    file_ext[3] = '\0';
+    next_block = 0;
+    active = true;
+    upload_begin();
+    reply(UPLOAD_ACK);
+}
+
+static void frame_data(const uint8_t *payload, uint32_t len)
+{
+    uint32_t block = get_uint32(payload);
+    uint32_t data_len = len - 4;
+
+    if (!active || len < 4 || block != next_block || block >= file_blocks ||
+        data_len != (block == file_blocks - 1 ? file_size - block * UPLOAD_BLOCK_SIZE : UPLOAD_BLOCK_SIZE)) {
+        // Out of order, probably after a dropped frame. Host goes back to next_block.
+        reply(UPLOAD_NAK);
+        return;
+    }
+
+    uint8_t *dest = store + block * UPLOAD_BLOCK_SIZE;
+    memcpy(dest, payload + 4, data_len);
+    memset(dest + data_len, 0, UPLOAD_BLOCK_SIZE - data_len);
+    next_block++;
+    reply(UPLOAD_ACK);
+}
+
+static void frame_end(void)
+{
+    if (committed) {
+        // Host lost our ACK and asks again; the file is already out
+        reply(UPLOAD_ACK);
+        return;
+    }
+    if (!active || next_block != file_blocks) {
+        reply(UPLOAD_NAK);
+        return;
+    }
+
+    active = false;
+    committed = true;
+    reply(UPLOAD_ACK);
+    upload_complete(file_size, file_name, file_ext);
+}
+
+static void frame_dispatch(void)
+{
+    const uint8_t *payload = rx_frame + 3;
+
+    if (crc32(rx_frame, 3 + rx_len) != get_uint32(rx_crc)) {
+        reply(UPLOAD_NAK);
+        return;
+    }
+
+    switch (rx_frame[0]) {
+        case 'S':   frame_start(payload, rx_len);   break;
+        case 'D':   frame_data(payload, rx_len);    break;
+        case 'E':   frame_end();                    break;
+        default:    reply(UPLOAD_NAK);              break;
+    }
+}
+
+void upload_init(uint8_t *buffer, uint32_t capacity)
+{
+    store = buffer;
+    store_capacity = capacity;
+}
+
+bool upload_active(void)
+{
+    return active || rx_state != RX_IDLE;
+}
+
+uint32_t upload_progress(void)
+{
+    return next_block * UPLOAD_BLOCK_SIZE;
+}
+
+void upload_rx(uint8_t chr)
+{
+    elapsed(&rx_last_byte, -1);
+
+    switch (rx_state) {
+
+        case RX_IDLE:
+            // Stray bytes between frames are ignored
+            if (chr == UPLOAD_SOH) {
+                rx_count = 0;
+                rx_state = RX_HEADER;
+            }
+            break;
+
+        case RX_HEADER:
+            rx_frame[rx_count++] = chr;
+            if (rx_count == 3) {
+                rx_len = rx_frame[1] | (rx_frame[2] << 8);
+                if (rx_len > UPLOAD_MAX_PAYLOAD) {
+                    rx_state = RX_IDLE;
+                    reply(UPLOAD_NAK);
+                } else {
+                    rx_state = rx_len ? RX_PAYLOAD : RX_CRC;
+                    rx_count = 0;
+                }
+            }
+            break;
+
+        case RX_PAYLOAD:
+            rx_frame[3 + rx_count++] = chr;
+            if (rx_count == rx_len) {
+                rx_state = RX_CRC;
+                rx_count = 0;
+            }
+            break;
+
+        case RX_CRC:
+            rx_crc[rx_count++] = chr;
+            if (rx_count == 4) {
+                rx_state = RX_IDLE;
+                elapsed(&rx_last_frame, -1);
+                frame_dispatch();
+            }
+            break;
+    }
+}
+
+void upload_poll(void)
+{
+    if (rx_state != RX_IDLE && elapsed(&rx_last_byte, UPLOAD_BYTE_TIMEOUT)) {
+        // Lost part of a frame
+        rx_state = RX_IDLE;
+        reply(UPLOAD_NAK);
+    }
+
+    if (active && rx_state == RX_IDLE && elapsed(&rx_last_frame, UPLOAD_IDLE_TIMEOUT)) {
+        // Host went away. A partial file is no file; the card keeps
+        // showing the empty one from upload_begin().
+        active = false;
+        next_block = 0;
+    }
+}
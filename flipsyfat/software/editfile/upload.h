@@ -0,0 +1,44 @@
+// Binary file upload over the UART
+
+#ifndef _UPLOAD_H
+#define _UPLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Host to board frames, little endian:
+//
+//   SOH, type, length (2), payload, crc32 (4) of type through payload
+//
+//   'S'  start   size (4), name (8), ext (3)
+//   'D'  data    block number (4), up to UPLOAD_BLOCK_SIZE bytes
+//   'E'  end     no payload
+//
+// The board answers each frame with ACK or NAK followed by the next block
+// number it expects (4). ACKs are cumulative, so the host can keep a window
+// of blocks in flight and go back to the NAKed block on errors. Nothing else
+// is printed while an upload is active.
+//
+// An 'E' repeated after the file went out is ACKed again. An upload that
+// goes quiet for UPLOAD_IDLE_TIMEOUT is abandoned and the card keeps
+// showing an empty file.
+
+#define UPLOAD_SOH          0x01
+#define UPLOAD_ACK          0x06
+#define UPLOAD_NAK          0x15
+#define UPLOAD_BLOCK_SIZE   512
+#define UPLOAD_MAX_PAYLOAD  (4 + UPLOAD_BLOCK_SIZE)
+#define UPLOAD_BYTE_TIMEOUT (CONFIG_CLOCK_FREQUENCY / 20)
+#define UPLOAD_IDLE_TIMEOUT (CONFIG_CLOCK_FREQUENCY * 2)
+
+void upload_init(uint8_t *store, uint32_t capacity);
+bool upload_active(void);
+void upload_rx(uint8_t chr);
+void upload_poll(void);
+uint32_t upload_progress(void);
+
+// Callbacks
+void upload_begin(void);
+void upload_complete(uint32_t size, const char *name, const char *ext);
+
+#endif // _UPLOAD_H
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Upload a file into the editfile firmware's emulated card.
+
+   Usage: upload.py [--window N] serial-port baudrate file [NAME.EXT]
+
+   See upload.h for the frame format. Blocks are sent with up to 'window'
+   frames in flight; on a NAK or a timeout, sending restarts from the block
+   number the board reported.
+   """
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+SOH = 0x01
+ACK = 0x06
+NAK = 0x15
+BLOCK_SIZE = 512
+
+
+def frame(kind, payload=b""):
+    body = kind + struct.pack("<H", len(payload)) + payload
+    return bytes([SOH]) + body + struct.pack("<I", zlib.crc32(body) & 0xffffffff)
+
+
+def short_name(path, override):
+    name, _, ext = (override or os.path.basename(path)).upper().partition(".")
+    return name[:8].ljust(8).encode(), ext[:3].ljust(3).encode()
+
+
+class Link:
+    def __init__(self, port, baud):
+        self.port = serial.Serial(port, baud, timeout=0.5)
+
+    def send(self, data):
+        self.port.write(data)
+
+    def reply(self):
+        # Skip anything that isn't a reply, like the tail of a screen update
+        while True:
+            code = self.port.read(1)
+            if not code:
+                return None, None
+            if code[0] in (ACK, NAK):
+                seq = self.port.read(4)
+                if len(seq) == 4:
+                    return code[0], struct.unpack("<I", seq)[0]
+
+
+def transfer(link, data, name, ext, window):
+    blocks = [data[i:i+BLOCK_SIZE] for i in range(0, len(data), BLOCK_SIZE)]
+
+    link.send(frame(b"S", struct.pack("<I", len(data)) + name + ext))
+    code, seq = link.reply()
+    if code != ACK:
+        raise IOError("board refused upload (file too large?)")
+
+    acked = 0
+    sent = 0
+    start = time.time()
+    while acked < len(blocks):
+        while sent < len(blocks) and sent - acked < window:
+            link.send(frame(b"D", struct.pack("<I", sent) + blocks[sent]))
+            sent += 1
+
+        code, seq = link.reply()
+        if code is None:
+            # Lost frame or reply; go back to the last known position
+            sent = acked
+        elif code == ACK:
+            acked = max(acked, seq)
+        else:
+            acked = seq
+            sent = seq
+            # Drain replies for frames that were already in flight
+            while link.reply()[0] is not None:
+                pass
+
+        sys.stderr.write("\r{:8d} / {:8d} bytes, {:6.1f} kB/s".format(
+            min(acked * BLOCK_SIZE, len(data)), len(data),
+            acked * BLOCK_SIZE / 1024 / max(time.time() - start, 1e-3)))
+
+    for attempt in range(5):
+        link.send(frame(b"E"))
+        code, seq = link.reply()
+        if code == ACK:
+            sys.stderr.write("\ndone\n")
+            return
+    raise IOError("board did not confirm end of upload")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--window", type=int, default=8, help="data frames in flight")
+    parser.add_argument("port")
+    parser.add_argument("baudrate", type=int)
+    parser.add_argument("file")
+    parser.add_argument("name", nargs="?", help="8.3 name on the card")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        data = f.read()
+    name, ext = short_name(args.file, args.name)
+    transfer(Link(args.port, args.baudrate), data, name, ext, max(1, args.window))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,16 @@
+// zlib-compatible CRC32, as in libbase
+
+#include <crc.h>
+
+unsigned int crc32(const unsigned char *buffer, unsigned int len)
+{
+    unsigned int crc = 0xffffffff;
+
+    while (len--) {
+        crc ^= *(buffer++);
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,342 @@
+// Run the wordlist guesser against a simulated victim, to compare
+// search strategies without spending hours on real hardware.
+//
+// The real guesser.c queue and fat.c directory generation run unchanged on
+// a virtual clock (see sim.c). Firmware output goes to /dev/null unless -v
+// is given; the report goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fat.h"
+#include "guesser.h"
+#include "mask.h"
+#include "profile.h"
+#include "metrics.h"
+#include "sim.h"
+#include "victim.h"
+
+#define CHARSET_FIRST   ' '
+#define CHARSET_LAST    '`'
+#define CHARSET_LEN     (CHARSET_LAST - CHARSET_FIRST + 1)
+#define FILLER          '~'     // Never in a name from the charset
+
+static const victim_model_t *models[] = {
+    &victim_compare,
+};
+
+static uint8_t secret[11];
+static uint64_t max_guesses = 10000000;
+static double max_seconds = 30 * 24 * 3600.0;
+static uint32_t prefix_reps = 3;
+static const char *mask_spec = "?a?a?a?a";
+static unsigned mask_min = 1;
+static uint8_t recovered[11];
+static bool recovered_valid = false;
+
+// Results for the prefix strategy's current position
+static unsigned prefix_pos;
+static uint64_t prefix_sum[256];
+static uint32_t prefix_count[256];
+
+
+static bool should_stop(void)
+{
+    return sim_found ||
+        qptr_read_measurement >= max_guesses ||
+        sim_now / (double) CONFIG_CLOCK_FREQUENCY >= max_seconds;
+}
+
+static void parse_name(uint8_t *dest, const char *name)
+{
+    const char *dot = strchr(name, '.');
+    unsigned len = dot ? dot - name : strlen(name);
+
+    memset(dest, ' ', 11);
+    for (unsigned i = 0; i < len && i < 8; i++) {
+        dest[i] = toupper((unsigned char) name[i]);
+    }
+    for (unsigned i = 0; dot && dot[1 + i] && i < 3; i++) {
+        dest[8 + i] = toupper((unsigned char) dot[1 + i]);
+    }
+}
+
+// The enumeration in wordlist/main.c
+static void strategy_wordlist(const mask_t *mask)
+{
+    mask_state_t state;
+    char name[9], ext[4];
+
+    mask_start(mask, &state);
+    while (!should_stop() && mask_next(mask, &state, name, ext)) {
+        guess_filename(name, ext);
+    }
+}
+
+// Find the name one byte at a time: with the known prefix fixed, the
+// candidate that takes longest matched one more byte.
+static void strategy_prefix(void)
+{
+    for (prefix_pos = 0; prefix_pos < sizeof recovered && !should_stop(); prefix_pos++) {
+        uint32_t issued[256] = { 0 };
+        unsigned best = CHARSET_FIRST, runner_up = CHARSET_FIRST;
+        double best_mean = -1, runner_up_mean = -1;
+
+        memset(prefix_sum, 0, sizeof prefix_sum);
+        memset(prefix_count, 0, sizeof prefix_count);
+
+        while (!should_stop()) {
+            unsigned next = 0;
+            char guess[11];
+
+            // Every candidate 'reps' times, then top up whichever
+            // results went missing until they're all in
+            for (unsigned c = CHARSET_FIRST; c <= CHARSET_LAST && !next; c++) {
+                if (issued[c] < prefix_reps) next = c;
+            }
+            for (unsigned c = CHARSET_FIRST; c <= CHARSET_LAST && !next; c++) {
+                if (prefix_count[c] < prefix_reps && (!next || issued[c] < issued[next])) next = c;
+            }
+            if (!next) {
+                break;
+            }
+
+            memcpy(guess, recovered, prefix_pos);
+            memset(guess + prefix_pos, FILLER, sizeof guess - prefix_pos);
+            guess[prefix_pos] = next;
+            issued[next]++;
+            guess_filename(guess, guess+8);
+        }
+
+        if (should_stop()) {
+            break;
+        }
+
+        for (unsigned c = CHARSET_FIRST; c <= CHARSET_LAST; c++) {
+            double mean = prefix_count[c] ? prefix_sum[c] / (double) prefix_count[c] : 0;
+            if (mean > best_mean) {
+                runner_up = best;
+                runner_up_mean = best_mean;
+                best = c;
+                best_mean = mean;
+            } else if (mean > runner_up_mean) {
+                runner_up = c;
+                runner_up_mean = mean;
+            }
+        }
+
+        recovered[prefix_pos] = best;
+        fprintf(stderr, "  byte %2d: '%c' %.0f cycles, next best '%c' %.0f\n",
+            prefix_pos, best, best_mean, runner_up, runner_up_mean);
+    }
+    recovered_valid = prefix_pos == sizeof recovered;
+}
+
+void guess_result(const queue_entry *entry)
+{
+    const uint8_t *g = guess_short_entry(entry);
+
+    if (!entry->measurement || prefix_pos >= sizeof recovered ||
+        memcmp(g, recovered, prefix_pos)) {
+        return;
+    }
+    for (unsigned i = prefix_pos + 1; i < sizeof recovered; i++) {
+        if (g[i] != FILLER) return;
+    }
+
+    prefix_sum[g[prefix_pos]] += entry->measurement;
+    prefix_count[g[prefix_pos]]++;
+}
+
+// A sector of one normal guess, timed by the model as the firmware would
+// measure it, against the firmware's normal window. Returns the exit code.
+static int check_calibration(const victim_model_t *model)
+{
+    const unsigned rounds = 256;
+    uint8_t sector[FAT_DENTRY_PER_SECTOR * FAT_DENTRY_SIZE];
+    uint8_t dentry[FAT_DENTRY_SIZE] = { 0 };
+    uint32_t low, high;
+    uint64_t sum = 0;
+
+    memcpy(dentry, secret, sizeof secret);
+    dentry[0] = secret[0] == 'A' ? 'B' : 'A';
+    dentry[0x0b] = 0x20;
+    for (unsigned i = 0; i < FAT_DENTRY_PER_SECTOR; i++) {
+        memcpy(sector + i * FAT_DENTRY_SIZE, dentry, FAT_DENTRY_SIZE);
+    }
+
+    for (unsigned i = 0; i < rounds; i++) {
+        uint32_t cycles;
+        unsigned found;
+        model->scan_sector(sector, &cycles, &found);
+        sum += cycles + sim_timing.command_cycles;
+    }
+
+    uint32_t mean = sum / rounds;
+    guesser_normal_window(&low, &high);
+    fprintf(stderr, "normal guess: %u cycles, window %u-%u, %s\n",
+        (unsigned) mean, (unsigned) low, (unsigned) high,
+        mean >= low && mean <= high ? "inside" : "OUTSIDE");
+    return mean >= low && mean <= high ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: guesssim [-v] [-C] [-P] [-p] [-R] [-m model] [-o key=value]... [-s NAME.EXT] [-S strategy]\n"
+        "                [-r reps] [-g max-guesses] [-t max-victim-seconds] [-x seed]\n"
+        "                [-M mask] [-L min-length]   (wordlist strategy, see mask.h)\n"
+        "                [-T max-tracked-names]\n"
+        "-p adds a timing profile of each scan to the -v output, see profile.h\n"
+        "-R adds every result, for resultrank\n"
+        "-C only checks that the model's normal guesses land in the normal window\n"
+        "-v output ends with the metrics line, see metrics.h\n"
+        "strategies: wordlist prefix\n"
+        "models:\n");
+    for (unsigned i = 0; i < sizeof models / sizeof models[0]; i++) {
+        fprintf(stderr, "  %s: %s\n", models[i]->name, models[i]->options);
+    }
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const victim_model_t *model = models[0];
+    const char *strategy = "prefix";
+    const char *options[32];
+    unsigned num_options = 0;
+    uint32_t seed = 1;
+    bool verbose = false;
+    bool check = false;
+    struct timespec start, end;
+    double wall, victim_seconds;
+    int opt;
+
+    parse_name(secret, "SECRET.BIN");
+
+    while ((opt = getopt(argc, argv, "vCPpRm:o:s:S:r:g:t:x:M:L:T:")) != -1) {
+        switch (opt) {
+            case 'v':   verbose = true;                             break;
+            case 'C':   check = true;                               break;
+            case 'P':   guesser_set_per_scan(true);                 break;
+            case 'p':   profile_enable(true);                       break;
+            case 'R':   guesser_log_results(true);                  break;
+            case 's':   parse_name(secret, optarg);                 break;
+            case 'S':   strategy = optarg;                          break;
+            case 'r':   prefix_reps = strtoul(optarg, 0, 0);        break;
+            case 'g':   max_guesses = strtoull(optarg, 0, 0);       break;
+            case 't':   max_seconds = strtod(optarg, 0);            break;
+            case 'x':   seed = strtoul(optarg, 0, 0);               break;
+            case 'M':   mask_spec = optarg;                         break;
+            case 'L':   mask_min = strtoul(optarg, 0, 0);           break;
+            case 'T':
+                if (!guesser_track_candidates(strtoul(optarg, 0, 0))) usage();
+                break;
+            case 'o':
+                if (num_options == sizeof options / sizeof options[0]) usage();
+                options[num_options++] = optarg;
+                break;
+            case 'm':
+                model = 0;
+                for (unsigned i = 0; i < sizeof models / sizeof models[0]; i++) {
+                    if (!strcmp(optarg, models[i]->name)) model = models[i];
+                }
+                if (!model) usage();
+                break;
+            default:
+                usage();
+        }
+    }
+
+    for (unsigned i = 0; i < num_options; i++) {
+        char key[64];
+        const char *eq = strchr(options[i], '=');
+        if (!eq || eq - options[i] >= sizeof key) usage();
+        memcpy(key, options[i], eq - options[i]);
+        key[eq - options[i]] = '\0';
+        if (!model->option(key, eq + 1)) {
+            fprintf(stderr, "unknown option '%s' for model %s\n", key, model->name);
+            usage();
+        }
+    }
+
+    mask_t mask;
+    if (!mask_parse(&mask, mask_spec, mask_min)) {
+        usage();
+    }
+
+    if (!verbose && !freopen("/dev/null", "w", stdout)) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    model->start(secret, seed);
+    if (check) {
+        return check_calibration(model);
+    }
+    sim_init(model);
+
+    fprintf(stderr, "strategy=%s model=%s secret=[%.8s.%.3s]\n",
+        strategy, model->name, secret, secret + 8);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    reset_pulse();
+    if (!strcmp(strategy, "wordlist")) {
+        strategy_wordlist(&mask);
+    } else if (!strcmp(strategy, "prefix")) {
+        strategy_prefix();
+    } else {
+        usage();
+    }
+
+    profile_emit(true);
+    metrics_print();    // What a '?' would have said at the end
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    victim_seconds = sim_now / (double) CONFIG_CLOCK_FREQUENCY;
+
+    if (sim_found) {
+        fprintf(stderr, "victim found [%.8s.%.3s]\n", sim_found_name, sim_found_name + 8);
+    } else if (recovered_valid) {
+        fprintf(stderr, "recovered [%.8s.%.3s], %s\n", recovered, recovered + 8,
+            memcmp(recovered, secret, sizeof secret) ? "wrong" : "correct");
+    } else {
+        fprintf(stderr, "not recovered\n");
+    }
+
+    fprintf(stderr, "guesses=%llu enqueued=%llu resets=%u scans=%llu outliers=%u\n",
+        (unsigned long long) qptr_read_measurement, (unsigned long long) qptr_write_guess,
+        reset_counter, (unsigned long long) sim_stats.scans, num_outliers);
+    fprintf(stderr, "controls: health %d%% drift %d, deleted %d/%u, label %d/%u cycles/results\n",
+        guesser_channel_health(), (int) guesser_drift(),
+        (int) control_stats[0].ewma, control_stats[0].results,
+        (int) control_stats[1].ewma, control_stats[1].results);
+    if (guess_candidates.count) {
+        uint32_t unusual = 0;
+        cand_name_t packed;
+        candidate_t *c = cand_pack(&packed, secret) ? candset_find(&guess_candidates, packed) : 0;
+
+        for (uint32_t i = 0; i < candset_slots(&guess_candidates); i++) {
+            candidate_t *slot = candset_slot(&guess_candidates, i);
+            unusual += slot && (slot->flags & CAND_OUTLIER);
+        }
+        fprintf(stderr, "tracked %u names, %u unusual; secret ", guess_candidates.count, unusual);
+        if (c) {
+            fprintf(stderr, "mean %u over %u%s\n", cand_mean(c), c->count,
+                (c->flags & CAND_OUTLIER) ? ", unusual" : "");
+        } else {
+            fprintf(stderr, "not tracked\n");
+        }
+    }
+    fprintf(stderr, "victim time %.1f s (%.2f h), wall %.2f s: %.0f guesses/s %.0f resets/s %.0f scans/s\n",
+        victim_seconds, victim_seconds / 3600, wall,
+        qptr_read_measurement / wall, reset_counter / wall, sim_stats.scans / wall);
+
+    return sim_found || (recovered_valid && !memcmp(recovered, secret, sizeof secret)) ? 0 : 2;
+}
@@ -0,0 +1,147 @@
+// Write the volume an app's block_read() serves out as a disk image.
+//
+// Built once per app (imgdump-editfile and so on), with the app's own
+// main() renamed to app_main(). That runs until it first polls the UART,
+// which is taken as the end of its setup; then every block from LBA 0 to
+// the end of the partition is generated and written out, to a file or to
+// a pipe.
+//
+// With -s, all-zero blocks are left as holes when the output can seek, so
+// a 30 MB image of a mostly empty volume takes almost no disk space.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <uart.h>
+
+#include "fat.h"
+#include "sdemu.h"
+#include "sim.h"
+
+#define IMAGE_BLOCKS    (FAT_PARTITION_END + 1)
+#define OUTPUT_BLOCKS   256
+
+int app_main(void);
+
+static jmp_buf app_ready;
+static int out_fd;
+static bool out_seekable;
+static uint8_t out_buf[OUTPUT_BLOCKS * BLOCK_SIZE];
+static uint32_t out_len;
+static uint64_t out_holes;
+
+
+static void app_polled_uart(void)
+{
+    host_uart_poll_hook = 0;
+    longjmp(app_ready, 1);
+}
+
+static void out_flush(void)
+{
+    uint8_t *p = out_buf;
+
+    while (out_len) {
+        ssize_t n = write(out_fd, p, out_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(1);
+        }
+        p += n;
+        out_len -= n;
+    }
+}
+
+static void out_block(const uint8_t *block, bool sparse)
+{
+    if (sparse && out_seekable) {
+        bool zero = block[0] == 0 && !memcmp(block, block + 1, BLOCK_SIZE - 1);
+        if (zero) {
+            out_flush();
+            if (lseek(out_fd, BLOCK_SIZE, SEEK_CUR) < 0) {
+                perror("lseek");
+                exit(1);
+            }
+            out_holes++;
+            return;
+        }
+    }
+
+    memcpy(out_buf + out_len, block, BLOCK_SIZE);
+    out_len += BLOCK_SIZE;
+    if (out_len == sizeof out_buf) {
+        out_flush();
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s] [-v] [-o image] [-f first-lba] [-n blocks]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = 0;
+    uint32_t first = 0;
+    uint32_t count = IMAGE_BLOCKS;
+    bool sparse = false;
+    bool verbose = false;
+    uint8_t block[BLOCK_SIZE];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "svo:f:n:")) != -1) {
+        switch (opt) {
+            case 's':   sparse = true;                          break;
+            case 'v':   verbose = true;                         break;
+            case 'o':   path = optarg;                          break;
+            case 'f':   first = strtoul(optarg, 0, 0);          break;
+            case 'n':   count = strtoul(optarg, 0, 0);          break;
+            default:    usage(argv[0]);
+        }
+    }
+
+    // Image goes to the real stdout; firmware chatter goes elsewhere
+    fflush(stdout);
+    out_fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : dup(1);
+    if (out_fd < 0) {
+        perror(path ? path : "stdout");
+        return 1;
+    }
+    out_seekable = lseek(out_fd, 0, SEEK_CUR) >= 0;
+    if (!freopen(verbose ? "/dev/stderr" : "/dev/null", "w", stdout)) {
+        perror("freopen");
+        return 1;
+    }
+
+    if (!setjmp(app_ready)) {
+        host_uart_poll_hook = app_polled_uart;
+        app_main();
+        host_uart_poll_hook = 0;
+    }
+
+    for (uint32_t lba = first; lba < first + count; lba++) {
+        block_read(block, lba);
+        out_block(block, sparse);
+    }
+    out_flush();
+
+    // Trailing holes don't extend the file by themselves
+    if (out_holes && ftruncate(out_fd, (off_t) count * BLOCK_SIZE) < 0) {
+        perror("ftruncate");
+        return 1;
+    }
+    close(out_fd);
+
+    fprintf(stderr, "%u blocks from LBA %u, %llu left as holes\n",
+        count, first, (unsigned long long) out_holes);
+    return 0;
+}
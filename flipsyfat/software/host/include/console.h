@@ -0,0 +1,6 @@
+// Host stand-in for libbase console.h
+
+#ifndef __CONSOLE_H
+#define __CONSOLE_H
+
+#endif
@@ -0,0 +1,8 @@
+// Host stand-in for libbase crc.h
+
+#ifndef __CRC_H
+#define __CRC_H
+
+unsigned int crc32(const unsigned char *buffer, unsigned int len);
+
+#endif
@@ -0,0 +1,36 @@
+// Host stand-in for the SoC's generated CSR accessors
+
+#ifndef __GENERATED_CSR_H
+#define __GENERATED_CSR_H
+
+#include <stdint.h>
+
+#define CSR_SDEMU_BASE      1
+#define CSR_SDTIMER_BASE    1
+#define CSR_SDTRIG_BASE     1
+#define SDEMU_INTERRUPT     1
+
+// Implemented by the simulator
+void sdemu_reset_write(uint32_t value);
+uint32_t sdemu_reset_read(void);
+uint32_t sdemu_read_bank_read(void);
+
+void sdtimer_capture_write(uint32_t value);
+uint32_t sdtimer_capture_ts_read(void);
+uint32_t sdtimer_read_ts_read(void);
+uint32_t sdtimer_write_ts_read(void);
+uint32_t sdtimer_done_ts_read(void);
+
+// Registers with no effect on the simulation
+#define HOST_CSR_REGISTER(name) \
+    extern uint32_t host_csr_##name; \
+    static inline uint32_t name##_read(void) { return host_csr_##name; } \
+    static inline void name##_write(uint32_t value) { host_csr_##name = value; }
+
+HOST_CSR_REGISTER(sdtrig_latch)
+HOST_CSR_REGISTER(sdtrig_latch_next)
+HOST_CSR_REGISTER(gpio_out)
+HOST_CSR_REGISTER(gpio_oe)
+HOST_CSR_REGISTER(clkout_div)
+
+#endif
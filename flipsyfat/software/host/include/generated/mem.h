@@ -0,0 +1,11 @@
+// Host stand-in for the SoC's generated memory map
+
+#ifndef __GENERATED_MEM_H
+#define __GENERATED_MEM_H
+
+// Never dereferenced on the host
+#define SDEMU_BASE      0x30000000UL
+#define MAIN_RAM_BASE   0x40000000UL
+#define MAIN_RAM_SIZE   0x00800000
+
+#endif
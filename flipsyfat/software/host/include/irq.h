@@ -0,0 +1,13 @@
+// Host stand-in for libbase irq.h; the simulated SD interrupt is
+// synchronous, so there is nothing to mask
+
+#ifndef __IRQ_H
+#define __IRQ_H
+
+static inline unsigned int irq_getie(void) { return 1; }
+static inline void irq_setie(unsigned int ie) {}
+static inline unsigned int irq_getmask(void) { return 0; }
+static inline void irq_setmask(unsigned int mask) {}
+static inline unsigned int irq_pending(void) { return 0; }
+
+#endif
@@ -0,0 +1,10 @@
+// Host stand-in for libbase system.h
+
+#ifndef __SYSTEM_H
+#define __SYSTEM_H
+
+static inline void flush_cpu_icache(void) {}
+static inline void flush_cpu_dcache(void) {}
+static inline void flush_l2_cache(void) {}
+
+#endif
@@ -0,0 +1,12 @@
+// Host stand-in for libbase time.h, on top of the C library's.
+// Time is the simulator's virtual system clock.
+
+#include_next <time.h>
+
+#ifndef __HOST_TIME_H
+#define __HOST_TIME_H
+
+void time_init(void);
+int elapsed(int *last_event, int period);
+
+#endif
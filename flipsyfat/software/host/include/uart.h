@@ -0,0 +1,22 @@
+// Host stand-in for libbase uart.h. There's never any input; tools that
+// need to know when firmware starts waiting for some can hook the poll.
+
+#ifndef __UART_H
+#define __UART_H
+
+extern void (*host_uart_poll_hook)(void);
+
+static inline void uart_init(void) {}
+static inline void uart_sync(void) {}
+static inline char uart_read(void) { return 0; }
+static inline void uart_write(char c) {}
+
+static inline int uart_read_nonblock(void)
+{
+    if (host_uart_poll_hook) {
+        host_uart_poll_hook();
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,689 @@
+// Rank candidate names from a stream of guesser results.
+//
+// Reads the R lines wordlist prints with -DWORDLIST_RESULTS (or guesssim
+// -v -R), from files or a live stream like the serial port, and ignores
+// everything else. Every normal result adds to its name's running
+// statistics, after the drift the control experiments see is taken out.
+// Names are ranked by how far their mean is from that of all results, in
+// standard errors.
+//
+// Work is spread over threads: the input is cut into blocks of whole
+// lines and parsed in parallel, the blocks are put back in order for the
+// drift correction, then results go to shards by name, each with its own
+// thread and hash table. Ranking asks every shard for its best at once.
+// With -i the ranking is printed every so many seconds as input arrives.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "candidate.h"
+
+#define BLOCK_BYTES         (1 << 20)
+#define MAX_THREADS         64
+#define MAX_TOP             1000
+
+// Like the guesser's own control statistics
+#define CONTROL_KINDS       2
+#define CONTROL_CALIBRATION 32
+
+typedef struct {
+    uint64_t name;
+    int32_t measurement;
+    uint8_t kind;
+} record_t;
+
+// Anything that goes through a queue starts with one of these
+typedef struct item {
+    struct item *next;
+} item_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t room;
+    item_t *head, *tail;
+    unsigned count, limit;      // No limit if 0
+    bool closed;
+} queue_t;
+
+typedef struct {
+    item_t link;
+    uint64_t seq;
+    char *text;
+    size_t len;
+    record_t *records;
+    size_t num_records;
+} block_t;
+
+typedef struct {
+    item_t link;
+    size_t count;
+    record_t records[];
+} batch_t;
+
+// Welford's running mean and sum of squared deviations
+typedef struct {
+    uint64_t n;
+    double mean;
+    double m2;
+} stats_t;
+
+typedef struct {
+    uint64_t name;              // 0 for an empty slot; no name packs to 0
+    stats_t stats;
+} entry_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    queue_t batches;
+    entry_t *table;
+    uint64_t mask;
+    uint64_t count;
+} shard_t;
+
+typedef struct {
+    uint64_t name;
+    stats_t stats;
+    double score;
+} ranked_t;
+
+typedef struct {
+    shard_t *shard;
+    stats_t all;
+    unsigned top;
+    uint64_t min_count;
+    ranked_t *best;
+    unsigned num_best;
+} rank_job_t;
+
+typedef struct {
+    uint64_t results;
+    int32_t reference;
+    int32_t ewma;
+    int64_t calibration_sum;
+} control_t;
+
+static unsigned num_threads;
+static queue_t text_blocks;             // Reader to parsers
+static queue_t parsed_blocks;           // Parsers to sequencer, any order
+static shard_t shards[MAX_THREADS];
+
+// Sequencer's, read by the ranking under global_lock
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_t all_results;
+static control_t controls[CONTROL_KINDS];
+static uint64_t lines_parsed, results_skipped;
+
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size);
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void queue_init(queue_t *q, unsigned limit)
+{
+    pthread_mutex_init(&q->lock, 0);
+    pthread_cond_init(&q->ready, 0);
+    pthread_cond_init(&q->room, 0);
+    q->head = q->tail = 0;
+    q->count = 0;
+    q->limit = limit;
+    q->closed = false;
+}
+
+static void queue_push(queue_t *q, item_t *item)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->limit && q->count >= q->limit) {
+        pthread_cond_wait(&q->room, &q->lock);
+    }
+    item->next = 0;
+    if (q->tail) {
+        q->tail->next = item;
+    } else {
+        q->head = item;
+    }
+    q->tail = item;
+    q->count++;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Null once the queue is closed and empty
+static item_t *queue_pop(queue_t *q)
+{
+    item_t *item;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->head && !q->closed) {
+        pthread_cond_wait(&q->ready, &q->lock);
+    }
+    item = q->head;
+    if (item) {
+        q->head = item->next;
+        if (!q->head) {
+            q->tail = 0;
+        }
+        q->count--;
+        pthread_cond_signal(&q->room);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void queue_close(queue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void stats_add(stats_t *s, double x)
+{
+    double delta = x - s->mean;
+    s->n++;
+    s->mean += delta / s->n;
+    s->m2 += delta * (x - s->mean);
+}
+
+static double stats_sd(const stats_t *s)
+{
+    return s->n > 1 ? sqrt(s->m2 / (s->n - 1)) : 0;
+}
+
+
+// Parsers: "R kind replicate_count measurement name", in hex
+
+static bool parse_line(record_t *r, const char *line)
+{
+    unsigned kind, rep, measurement;
+    unsigned long long name;
+
+    if (line[0] != 'R' || line[1] != ' ' ||
+        sscanf(line + 2, "%x %x %x %llx", &kind, &rep, &measurement, &name) != 4) {
+        return false;
+    }
+    r->kind = kind;
+    r->measurement = measurement;
+    r->name = name;
+    return true;
+}
+
+static void *parser_thread(void *arg)
+{
+    block_t *b;
+
+    while ((b = (block_t *) queue_pop(&text_blocks))) {
+        size_t lines = 1;
+        char *line, *end = b->text + b->len;
+
+        for (char *p = b->text; p < end; p++) {
+            lines += *p == '\n';
+        }
+        b->records = xmalloc(lines * sizeof b->records[0]);
+        b->num_records = 0;
+
+        for (line = b->text; line < end; ) {
+            char *nl = memchr(line, '\n', end - line);
+            if (!nl) {
+                nl = end;
+            }
+            *nl = '\0';
+            if (parse_line(&b->records[b->num_records], line)) {
+                b->num_records++;
+            }
+            line = nl + 1;
+        }
+
+        free(b->text);
+        b->text = 0;
+        queue_push(&parsed_blocks, &b->link);
+    }
+    return 0;
+}
+
+
+// Sequencer: drift correction in input order, then out to the shards
+
+// Fibonacci hashing, as in candset, with the high bits folded down for
+// the table slots; the shard comes from the ones above
+static uint64_t name_hash(uint64_t name)
+{
+    uint64_t h = name * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+}
+
+static uint32_t shard_of(uint64_t name)
+{
+    return (uint32_t) (name_hash(name) >> 32) % num_threads;
+}
+
+// Of the first kind that has calibrated, like guesser_drift()
+static int32_t drift(void)
+{
+    for (int i = 0; i < CONTROL_KINDS; i++) {
+        if (controls[i].results > CONTROL_CALIBRATION) {
+            return controls[i].ewma - controls[i].reference;
+        }
+    }
+    return 0;
+}
+
+static void record_control(const record_t *r)
+{
+    control_t *c = &controls[r->kind - 1];
+
+    c->results++;
+    if (c->results <= CONTROL_CALIBRATION) {
+        c->calibration_sum += r->measurement;
+        if (c->results == CONTROL_CALIBRATION) {
+            c->reference = c->calibration_sum / CONTROL_CALIBRATION;
+            c->ewma = c->reference;
+        }
+    } else {
+        c->ewma += (r->measurement - c->ewma) / 16;
+    }
+}
+
+static void sequence_block(block_t *b)
+{
+    batch_t *batch[MAX_THREADS];
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        batch[i] = xmalloc(sizeof *batch[i] + b->num_records * sizeof batch[i]->records[0]);
+        batch[i]->count = 0;
+    }
+
+    pthread_mutex_lock(&global_lock);
+    for (size_t i = 0; i < b->num_records; i++) {
+        record_t *r = &b->records[i];
+
+        lines_parsed++;
+        if (!r->measurement || (r->kind == 0 && !r->name) || r->kind > CONTROL_KINDS) {
+            // Skipped by the victim, or nothing to rank it by
+            results_skipped++;
+            continue;
+        }
+        if (r->kind) {
+            record_control(r);
+            continue;
+        }
+        r->measurement -= drift();
+        stats_add(&all_results, r->measurement);
+
+        batch_t *to = batch[shard_of(r->name)];
+        to->records[to->count++] = *r;
+    }
+    pthread_mutex_unlock(&global_lock);
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        if (batch[i]->count) {
+            queue_push(&shards[i].batches, &batch[i]->link);
+        } else {
+            free(batch[i]);
+        }
+    }
+    free(b->records);
+    free(b);
+}
+
+static void *sequencer_thread(void *arg)
+{
+    block_t *pending = 0;       // Arrived early, sorted by seq
+    uint64_t next_seq = 0;
+    block_t *b;
+
+    while ((b = (block_t *) queue_pop(&parsed_blocks))) {
+        block_t **p = &pending;
+        while (*p && (*p)->seq < b->seq) {
+            p = (block_t **) &(*p)->link.next;
+        }
+        b->link.next = &(*p)->link;
+        *p = b;
+
+        while (pending && pending->seq == next_seq) {
+            b = pending;
+            pending = (block_t *) pending->link.next;
+            sequence_block(b);
+            next_seq++;
+        }
+    }
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        queue_close(&shards[i].batches);
+    }
+    return 0;
+}
+
+
+// Shards: per-name statistics in open addressing tables
+
+static entry_t *shard_entry(shard_t *s, uint64_t name)
+{
+    uint64_t i;
+
+    if ((s->count + 1) * 4 > (s->mask + 1) * 3) {
+        entry_t *old = s->table;
+        uint64_t old_size = s->mask + 1;
+
+        s->mask = old_size * 2 - 1;
+        s->table = calloc(s->mask + 1, sizeof s->table[0]);
+        if (!s->table) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (uint64_t j = 0; j < old_size; j++) {
+            if (old[j].name) {
+                for (i = name_hash(old[j].name) & s->mask; s->table[i].name;
+                     i = (i + 1) & s->mask);
+                s->table[i] = old[j];
+            }
+        }
+        free(old);
+    }
+
+    for (i = name_hash(name) & s->mask; s->table[i].name; i = (i + 1) & s->mask) {
+        if (s->table[i].name == name) {
+            return &s->table[i];
+        }
+    }
+    s->table[i].name = name;
+    s->count++;
+    return &s->table[i];
+}
+
+static void *shard_thread(void *arg)
+{
+    shard_t *s = arg;
+    batch_t *b;
+
+    while ((b = (batch_t *) queue_pop(&s->batches))) {
+        pthread_mutex_lock(&s->lock);
+        for (size_t i = 0; i < b->count; i++) {
+            stats_add(&shard_entry(s, b->records[i].name)->stats, b->records[i].measurement);
+        }
+        pthread_mutex_unlock(&s->lock);
+        free(b);
+    }
+    return 0;
+}
+
+
+// Ranking
+
+static void *rank_thread(void *arg)
+{
+    rank_job_t *job = arg;
+    shard_t *s = job->shard;
+    double all_sd = stats_sd(&job->all);
+
+    job->num_best = 0;
+    if (all_sd == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    for (uint64_t i = 0; i <= s->mask; i++) {
+        const entry_t *e = &s->table[i];
+        ranked_t r;
+        unsigned pos;
+
+        if (!e->name || e->stats.n < job->min_count) {
+            continue;
+        }
+        r.name = e->name;
+        r.stats = e->stats;
+        r.score = (e->stats.mean - job->all.mean) / (all_sd / sqrt(e->stats.n));
+
+        // Insertion into the short list, best first
+        for (pos = job->num_best; pos > 0 && fabs(job->best[pos - 1].score) < fabs(r.score); pos--);
+        if (pos == job->top) {
+            continue;
+        }
+        if (job->num_best < job->top) {
+            job->num_best++;
+        }
+        memmove(&job->best[pos + 1], &job->best[pos], (job->num_best - 1 - pos) * sizeof r);
+        job->best[pos] = r;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static int compare_ranked(const void *a, const void *b)
+{
+    double sa = fabs(((const ranked_t *) a)->score), sb = fabs(((const ranked_t *) b)->score);
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+static void print_ranking(unsigned top, uint64_t min_count)
+{
+    rank_job_t jobs[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    ranked_t *merged = xmalloc((size_t) top * num_threads * sizeof merged[0]);
+    unsigned num_merged = 0;
+    uint64_t names = 0, lines, skipped;
+    stats_t all;
+    int32_t now_drift;
+
+    pthread_mutex_lock(&global_lock);
+    all = all_results;
+    lines = lines_parsed;
+    skipped = results_skipped;
+    now_drift = drift();
+    pthread_mutex_unlock(&global_lock);
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        jobs[i] = (rank_job_t) {
+            .shard = &shards[i], .all = all, .top = top, .min_count = min_count,
+            .best = xmalloc(top * sizeof(ranked_t)),
+        };
+        pthread_create(&threads[i], 0, rank_thread, &jobs[i]);
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], 0);
+        memcpy(merged + num_merged, jobs[i].best, jobs[i].num_best * sizeof merged[0]);
+        num_merged += jobs[i].num_best;
+        free(jobs[i].best);
+
+        pthread_mutex_lock(&shards[i].lock);
+        names += shards[i].count;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    qsort(merged, num_merged, sizeof merged[0], compare_ranked);
+
+    printf("# %llu results, %llu skipped, %llu names; mean %.1f sd %.1f, drift %d\n",
+        (unsigned long long) lines, (unsigned long long) skipped, (unsigned long long) names,
+        all.mean, stats_sd(&all), (int) now_drift);
+    for (unsigned i = 0; i < num_merged && i < top; i++) {
+        uint8_t name[CAND_NAME_LEN];
+        cand_unpack(name, merged[i].name);
+        printf("%4u [%.8s.%.3s] n=%llu mean=%.1f sd=%.1f z=%+.2f\n", i + 1, name, name + 8,
+            (unsigned long long) merged[i].stats.n, merged[i].stats.mean,
+            stats_sd(&merged[i].stats), merged[i].score);
+    }
+    fflush(stdout);
+    free(merged);
+}
+
+
+// Reader: whole lines, in blocks
+
+static double seconds_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void send_block(uint64_t *seq, const char *text, size_t len)
+{
+    block_t *b = xmalloc(sizeof *b);
+
+    b->seq = (*seq)++;
+    b->text = xmalloc(len + 1);
+    memcpy(b->text, text, len);
+    b->len = len;
+    queue_push(&text_blocks, &b->link);
+}
+
+static void read_input(int fd, uint64_t *seq, double interval, unsigned top, uint64_t min_count)
+{
+    static double last_ranking;
+    char *buf = xmalloc(BLOCK_BYTES);
+    size_t fill = 0;
+
+    for (;;) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ssize_t n;
+
+        // Live input may go quiet; the ranking is due anyway
+        if (interval > 0) {
+            double now = seconds_now();
+            if (!last_ranking) {
+                last_ranking = now;
+            } else if (now - last_ranking >= interval) {
+                print_ranking(top, min_count);
+                last_ranking = now;
+            }
+            if (poll(&pfd, 1, 100) == 0) {
+                continue;
+            }
+        }
+
+        n = read(fd, buf + fill, BLOCK_BYTES - fill);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        fill += n;
+
+        // Pass on what's there once the block is full or the input paused
+        if (fill == BLOCK_BYTES || (size_t) n < BLOCK_BYTES - (fill - n)) {
+            char *last = memrchr(buf, '\n', fill);
+            if (!last) {
+                if (fill < BLOCK_BYTES) {
+                    continue;
+                }
+                // A line that long isn't ours
+                fill = 0;
+                continue;
+            }
+            size_t len = last + 1 - buf;
+            send_block(seq, buf, len);
+            memmove(buf, buf + len, fill - len);
+            fill -= len;
+        }
+    }
+
+    if (fill) {
+        send_block(seq, buf, fill);
+    }
+    free(buf);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: resultrank [-j threads] [-n top] [-m min-results] [-i seconds] [file|-]...\n"
+        "Ranks names by the R lines in the files, or standard input, as printed by\n"
+        "wordlist -DWORDLIST_RESULTS or guesssim -v -R. -i also prints the ranking\n"
+        "every so many seconds while reading.\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t parsers[MAX_THREADS], sequencer;
+    unsigned top = 20;
+    uint64_t min_count = 2;
+    double interval = 0;
+    uint64_t seq = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    num_threads = cpus > 0 ? cpus : 1;
+
+    while ((opt = getopt(argc, argv, "j:n:m:i:")) != -1) {
+        switch (opt) {
+            case 'j':   num_threads = strtoul(optarg, 0, 0);        break;
+            case 'n':   top = strtoul(optarg, 0, 0);                break;
+            case 'm':   min_count = strtoull(optarg, 0, 0);         break;
+            case 'i':   interval = strtod(optarg, 0);               break;
+            default:    usage();
+        }
+    }
+    if (num_threads < 1 || top < 1 || top > MAX_TOP) {
+        usage();
+    }
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+
+    queue_init(&text_blocks, num_threads * 2);
+    queue_init(&parsed_blocks, 0);
+    for (unsigned i = 0; i < num_threads; i++) {
+        shard_t *s = &shards[i];
+        pthread_mutex_init(&s->lock, 0);
+        queue_init(&s->batches, 64);
+        s->mask = 1023;
+        s->table = calloc(s->mask + 1, sizeof s->table[0]);
+        if (!s->table) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        pthread_create(&s->thread, 0, shard_thread, s);
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_create(&parsers[i], 0, parser_thread, 0);
+    }
+    pthread_create(&sequencer, 0, sequencer_thread, 0);
+
+    if (optind == argc) {
+        read_input(0, &seq, interval, top, min_count);
+    }
+    for (int i = optind; i < argc; i++) {
+        int fd = strcmp(argv[i], "-") ? open(argv[i], O_RDONLY) : 0;
+        if (fd < 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        read_input(fd, &seq, interval, top, min_count);
+        if (fd) {
+            close(fd);
+        }
+    }
+
+    queue_close(&text_blocks);
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_join(parsers[i], 0);
+    }
+    queue_close(&parsed_blocks);
+    pthread_join(sequencer, 0);
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_join(shards[i].thread, 0);
+    }
+
+    print_ranking(top, min_count);
+    return 0;
+}
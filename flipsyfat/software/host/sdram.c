@@ -0,0 +1,24 @@
+// Host version of common/sdram.c, backed by the C heap
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <generated/mem.h>
+#include "sdram.h"
+
+static uint32_t sdram_used = 0;
+
+
+uint32_t sdram_free_space(void)
+{
+    return MAIN_RAM_SIZE - SDRAM_STACK_RESERVE - sdram_used;
+}
+
+void *sdram_alloc(uint32_t size)
+{
+    size = (size + SDRAM_ALIGN - 1) & ~(uint32_t)(SDRAM_ALIGN - 1);
+    if (size > sdram_free_space()) {
+        return NULL;
+    }
+    sdram_used += size;
+    return calloc(1, size);
+}
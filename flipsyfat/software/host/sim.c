@@ -0,0 +1,224 @@
+// Virtual SD host and clock for running firmware code on the host
+//
+// Firmware code polls the clock in loops, so time only moves when it
+// asks: the SDTimer capture strobe and elapsed(). The victim runs as a
+// sequence of block reads; each read calls block_read() directly, the
+// same way the SD interrupt would.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <time.h>
+#include <generated/csr.h>
+
+#include "fat.h"
+#include "sdemu.h"
+#include "isr.h"
+#include "sim.h"
+
+#define IDLE_STEP   (CONFIG_CLOCK_FREQUENCY / 100)
+
+uint64_t sim_now;
+sim_timing_t sim_timing = {
+    .boot_cycles = CONFIG_CLOCK_FREQUENCY / 5,
+    .command_cycles = 48 * 16 * 2,
+    .transfer_cycles = (1024 + 16 + 2) * 16,
+    .mount_cycles = 50000,
+};
+sim_stats_t sim_stats;
+bool sim_found;
+uint8_t sim_found_name[11];
+
+// Registers the simulation doesn't look at
+uint32_t host_csr_sdtrig_latch;
+uint32_t host_csr_sdtrig_latch_next;
+uint32_t host_csr_gpio_out;
+uint32_t host_csr_gpio_oe;
+uint32_t host_csr_clkout_div;
+
+// From sdemu.c
+bool sdemu_prefetching = false;
+
+// From isr.c; block reads here aren't interrupts
+volatile uint32_t isr_busy_cycles;
+
+void (*host_uart_poll_hook)(void);
+
+static const victim_model_t *victim;
+
+static struct {
+    bool in_reset;
+    int step;               // Position in the read sequence, -1 when idle
+    uint64_t next_read;
+    uint32_t capture_ts;
+    uint32_t read_ts;
+    uint32_t write_ts;
+    uint32_t done_ts;
+} card = { .in_reset = true, .step = -1 };
+
+// MBR, boot sector, then the root directory until the victim stops
+static uint32_t sequence_lba(int step)
+{
+    switch (step) {
+        case 0:     return 0;
+        case 1:     return FAT_PARTITION_START;
+        default:    return FAT_ROOT_START + step - 2;
+    }
+}
+
+static void card_read(void)
+{
+    uint8_t buf[BLOCK_SIZE];
+    uint32_t lba = sequence_lba(card.step);
+    uint32_t cycles = sim_timing.mount_cycles;
+    uint64_t done = card.next_read + sim_timing.transfer_cycles;
+
+    card.read_ts = card.next_read;
+    block_read(buf, lba);
+    card.done_ts = done;
+    sim_stats.reads++;
+    card.step++;
+
+    if (lba >= FAT_ROOT_START && lba <= FAT_ROOT_END) {
+        unsigned index = 0;
+        sim_stats.scans++;
+
+        switch (victim->scan_sector(buf, &cycles, &index)) {
+            case VICTIM_FOUND:
+                sim_stats.finds++;
+                sim_found = true;
+                memcpy(sim_found_name, buf + index * FAT_DENTRY_SIZE, sizeof sim_found_name);
+                card.step = -1;
+                break;
+            case VICTIM_END:
+                card.step = -1;
+                break;
+        }
+        if (lba == FAT_ROOT_END) {
+            // Not found; victim gives up
+            card.step = -1;
+        }
+    }
+
+    card.next_read = done + cycles + sim_timing.command_cycles;
+}
+
+void sim_init(const victim_model_t *model)
+{
+    victim = model;
+}
+
+void sim_advance(void)
+{
+    static bool busy = false;
+    uint64_t step = IDLE_STEP;
+
+    if (busy) {
+        // Called from inside block_read(); the interrupt doesn't see time pass
+        return;
+    }
+    busy = true;
+
+    if (!card.in_reset && card.step >= 0) {
+        step = card.next_read > sim_now ? card.next_read - sim_now : 1;
+        if (step > IDLE_STEP) step = IDLE_STEP;
+    }
+    sim_now += step;
+
+    while (!card.in_reset && card.step >= 0 && card.next_read <= sim_now) {
+        card_read();
+    }
+
+    busy = false;
+}
+
+void time_init(void)
+{
+}
+
+int elapsed(int *last_event, int period)
+{
+    int t;
+
+    sim_advance();
+    t = (int) sim_now;
+
+    if (period < 0 || t - *last_event >= period) {
+        *last_event = t;
+        return 1;
+    }
+    return 0;
+}
+
+void sdemu_reset_write(uint32_t value)
+{
+    if (!victim) {
+        // Nothing on the other end of the card
+        return;
+    }
+
+    if (value) {
+        card.in_reset = true;
+        card.step = -1;
+    } else if (card.in_reset) {
+        card.in_reset = false;
+        card.step = 0;
+        card.next_read = sim_now + sim_timing.boot_cycles;
+        sim_stats.resets++;
+    }
+}
+
+uint32_t sdemu_reset_read(void)
+{
+    return card.in_reset;
+}
+
+void sdemu_init(void)
+{
+}
+
+void sdemu_status(void)
+{
+    printf("sim t=%llu\n", (unsigned long long) sim_now);
+}
+
+int sdemu_format_status(char *buf, int size)
+{
+    return snprintf(buf, size, "sim t=%llu", (unsigned long long) sim_now);
+}
+
+void sdemu_no_prefetch(uint32_t first, uint32_t last)
+{
+    // Nothing is read ahead here
+}
+
+uint32_t sdemu_read_bank_read(void)
+{
+    return 0;
+}
+
+void sdtimer_capture_write(uint32_t value)
+{
+    sim_advance();
+    card.capture_ts = sim_now;
+}
+
+uint32_t sdtimer_capture_ts_read(void)
+{
+    return card.capture_ts;
+}
+
+uint32_t sdtimer_read_ts_read(void)
+{
+    return card.read_ts;
+}
+
+uint32_t sdtimer_write_ts_read(void)
+{
+    return card.write_ts;
+}
+
+uint32_t sdtimer_done_ts_read(void)
+{
+    return card.done_ts;
+}
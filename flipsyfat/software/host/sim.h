@@ -0,0 +1,41 @@
+// Virtual SD host and clock for running firmware code on the host
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "victim.h"
+
+// Card-side timing, in system clock cycles
+typedef struct {
+    uint32_t boot_cycles;       // Reset release to first block read
+    uint32_t command_cycles;    // Read command and response
+    uint32_t transfer_cycles;   // One 512-byte block on the bus
+    uint32_t mount_cycles;      // Victim's work on each non-directory block
+} sim_timing_t;
+
+typedef struct {
+    uint64_t resets;
+    uint64_t reads;
+    uint64_t scans;             // Root directory sectors
+    uint64_t finds;
+} sim_stats_t;
+
+extern uint64_t sim_now;
+extern sim_timing_t sim_timing;
+extern sim_stats_t sim_stats;
+
+// Name in the entry the victim stopped on, once it has
+extern bool sim_found;
+extern uint8_t sim_found_name[11];
+
+// Without a model, the card never leaves reset
+void sim_init(const victim_model_t *model);
+
+// Every firmware time query moves the clock, either straight to the
+// victim's next block read or, while it's idle, by a coarse step.
+void sim_advance(void);
+
+#endif // _SIM_H
@@ -0,0 +1,33 @@
+// Victim models for the host simulator
+
+#ifndef _VICTIM_H
+#define _VICTIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum {
+    VICTIM_NEXT,        // Keep reading the directory
+    VICTIM_FOUND,       // Stopped on a matching entry
+    VICTIM_END,         // Stopped on an end-of-directory marker
+};
+
+// A model sees each root directory sector as the card serves it and
+// returns how many system clock cycles the victim spends on it before
+// asking for the next block.
+typedef struct victim_model {
+    const char *name;
+    const char *options;
+
+    // "key=value" settings from the command line; false if unknown
+    bool (*option)(const char *key, const char *value);
+
+    // Called once, with the 8.3 name the victim is looking for
+    void (*start)(const uint8_t *secret, uint32_t seed);
+
+    int (*scan_sector)(const uint8_t *sector, uint32_t *cycles, unsigned *found_index);
+} victim_model_t;
+
+extern const victim_model_t victim_compare;
+
+#endif // _VICTIM_H
@@ -0,0 +1,110 @@
+// Victim model: a plain byte-by-byte 8.3 name compare, like the
+// evaluatePath() loop in victims/propeller-p8x32a/SD-MMC_FATEngine.spin.
+//
+// For every directory entry that isn't free or a long name part, the
+// victim copies the 11 name bytes and strcomp()s them against the name it
+// wants, stopping at the first mismatch. Each entry costs a fixed amount
+// plus a little per byte compared, and every sector gets Gaussian noise.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fat.h"
+#include "victim.h"
+
+static uint8_t secret[11];
+// Defaults put a sector of names that differ from the first byte, plus the
+// read command sim.c adds, in the middle of the firmware's normal window;
+// guesssim -C checks that
+static uint32_t entry_cycles = 2024;
+static uint32_t char_cycles = 20;
+static uint32_t skip_cycles = 400;
+static double noise_cycles = 100.0;
+static uint64_t rng_state;
+
+
+static uint32_t rng_next(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ull) >> 32;
+}
+
+static double rng_gaussian(void)
+{
+    double u1 = (rng_next() + 1.0) / 4294967297.0;
+    double u2 = rng_next() / 4294967296.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static bool compare_option(const char *key, const char *value)
+{
+    if (!strcmp(key, "entry")) {
+        entry_cycles = strtoul(value, 0, 0);
+    } else if (!strcmp(key, "char")) {
+        char_cycles = strtoul(value, 0, 0);
+    } else if (!strcmp(key, "skip")) {
+        skip_cycles = strtoul(value, 0, 0);
+    } else if (!strcmp(key, "noise")) {
+        noise_cycles = strtod(value, 0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void compare_start(const uint8_t *name, uint32_t seed)
+{
+    memcpy(secret, name, sizeof secret);
+    rng_state = 0x9e3779b97f4a7c15ull ^ seed;
+}
+
+static int compare_scan_sector(const uint8_t *sector, uint32_t *cycles, unsigned *found_index)
+{
+    double total = 0;
+    int result = VICTIM_NEXT;
+
+    for (unsigned i = 0; i < FAT_DENTRY_PER_SECTOR; i++) {
+        const uint8_t *dentry = sector + i * FAT_DENTRY_SIZE;
+        unsigned matched = 0;
+
+        if (dentry[0] == 0x00) {
+            total += skip_cycles;
+            result = VICTIM_END;
+            break;
+        }
+
+        if (dentry[0] == 0xe5 || (dentry[0x0b] & 0x0f) == 0x0f) {
+            total += skip_cycles;
+            continue;
+        }
+
+        // strcomp() looks at one byte past the last match, up to the NUL
+        while (matched < sizeof secret && dentry[matched] == secret[matched]) {
+            matched++;
+        }
+        total += entry_cycles + char_cycles * (matched + 1);
+
+        if (matched == sizeof secret && !(dentry[0x0b] & 0x08)) {
+            *found_index = i;
+            result = VICTIM_FOUND;
+            break;
+        }
+    }
+
+    total += noise_cycles * rng_gaussian();
+    *cycles = total > 0 ? (uint32_t) total : 0;
+    return result;
+}
+
+const victim_model_t victim_compare = {
+    .name = "compare",
+    .options = "entry=CYCLES char=CYCLES skip=CYCLES noise=SIGMA",
+    .option = compare_option,
+    .start = compare_start,
+    .scan_sector = compare_scan_sector,
+};
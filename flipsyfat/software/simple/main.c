@@ -12,6 +12,7 @@
 #include "fat.h"
 #include "sdemu.h"
 #include "sdtimer.h"
+#include "bh.h"
 
 
 int main(void)
@@ -26,6 +27,8 @@ int main(void)
 
     while (1) {
         static int last_event = 0;
+
+        bh_run();
         if (elapsed(&last_event, CONFIG_CLOCK_FREQUENCY / 10)) {
             sdtimer_status();
             sdemu_status();
@@ -0,0 +1,102 @@
+// Short names packed into 64 bits, and a set of them with statistics
+
+#include <stdint.h>
+#include <string.h>
+
+#include "candidate.h"
+#include "sdram.h"
+
+static const char cand_chars[] = CAND_CHARS;
+
+_Static_assert(sizeof cand_chars - 1 == CAND_RADIX, "CAND_CHARS doesn't match CAND_RADIX");
+_Static_assert(sizeof(candidate_t) == 12, "candidate_t isn't packed");
+
+
+bool cand_pack(cand_name_t *packed, const uint8_t *name)
+{
+    cand_name_t value = 0;
+
+    for (int i = 0; i < CAND_NAME_LEN; i++) {
+        const char *code = name[i] ? strchr(cand_chars, name[i]) : 0;
+        if (!code) {
+            return false;
+        }
+        value = value * CAND_RADIX + (code - cand_chars);
+    }
+    *packed = value;
+    return true;
+}
+
+void cand_unpack(uint8_t *name, cand_name_t packed)
+{
+    for (int i = CAND_NAME_LEN - 1; i >= 0; i--) {
+        name[i] = cand_chars[packed % CAND_RADIX];
+        packed /= CAND_RADIX;
+    }
+}
+
+static uint32_t candset_home(const candset_t *set, cand_name_t name)
+{
+    // Fibonacci hashing, as in blockmap, over both halves
+    return ((uint32_t) name ^ (uint32_t) (name >> 32)) * 2654435761u >> set->shift;
+}
+
+bool candset_init(candset_t *set, uint32_t max_candidates)
+{
+    uint32_t slots = 2;
+    uint32_t shift = 31;
+
+    while (slots / 4 * 3 < max_candidates) {
+        slots <<= 1;
+        shift--;
+    }
+
+    set->slots = sdram_alloc(slots * sizeof set->slots[0]);
+    if (!set->slots) {
+        return false;
+    }
+    memset(set->slots, 0, slots * sizeof set->slots[0]);
+
+    set->mask = slots - 1;
+    set->shift = shift;
+    set->count = 0;
+    set->capacity = max_candidates;
+    return true;
+}
+
+candidate_t *candset_find(const candset_t *set, cand_name_t name)
+{
+    uint32_t i;
+
+    if (!set->capacity) {
+        return 0;
+    }
+    for (i = candset_home(set, name); set->slots[i].flags & CAND_USED; i = (i + 1) & set->mask) {
+        if (set->slots[i].name == name) {
+            return &set->slots[i];
+        }
+    }
+    return 0;
+}
+
+candidate_t *candset_insert(candset_t *set, cand_name_t name)
+{
+    uint32_t i;
+
+    if (!set->capacity) {
+        return 0;
+    }
+    for (i = candset_home(set, name); set->slots[i].flags & CAND_USED; i = (i + 1) & set->mask) {
+        if (set->slots[i].name == name) {
+            return &set->slots[i];
+        }
+    }
+    if (set->count == set->capacity) {
+        return 0;
+    }
+
+    set->slots[i].name = name;
+    set->slots[i].flags = CAND_USED;
+    set->count++;
+    return &set->slots[i];
+}
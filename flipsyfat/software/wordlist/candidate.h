@@ -0,0 +1,91 @@
+// Short names packed into 64 bits, and a set of them with statistics
+
+#ifndef _CANDIDATE_H
+#define _CANDIDATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Each of the 11 name bytes is one of 53 codes: space, then every character
+// a mask can produce (mask.h) in ASCII order. 53^11 fits in 64 bits, first
+// character most significant, so packed names sort like the names do. A
+// queue_entry is 144 bytes; a candidate with its statistics is 12.
+
+#define CAND_CHARS          " !#$%&'()-0123456789@ABCDEFGHIJKLMNOPQRSTUVWXYZ^_`{}~"
+#define CAND_RADIX          53
+#define CAND_NAME_LEN       11
+
+typedef uint64_t cand_name_t;
+
+// Statistics are quantized: the mean in units of 1 << CAND_QUANTUM_SHIFT
+// cycles, saturating, and the count saturating at 255, after which the
+// mean turns into a moving average over about that many results.
+#define CAND_QUANTUM_SHIFT  2
+
+#define CAND_TESTED         (1 << 0)    // Has at least one measurement
+#define CAND_OUTLIER        (1 << 1)    // At least one was unusual
+#define CAND_USED           (1 << 7)    // Slot holds a candidate
+
+typedef struct {
+    cand_name_t name;
+    uint16_t mean;
+    uint8_t count;
+    uint8_t flags;
+} __attribute__((packed, aligned(4))) candidate_t;
+
+// Open addressing with linear probing, at most 3/4 full. Main loop only;
+// nothing is ever removed. An unused set (never initialized) is empty and
+// refuses inserts.
+typedef struct {
+    candidate_t *slots;
+    uint32_t mask;
+    uint32_t shift;
+    uint32_t count;
+    uint32_t capacity;
+} candset_t;
+
+// False if the name has a byte outside CAND_CHARS
+bool cand_pack(cand_name_t *packed, const uint8_t *name);
+void cand_unpack(uint8_t *name, cand_name_t packed);
+
+static inline void cand_record(candidate_t *c, uint32_t measurement)
+{
+    uint32_t q = measurement >> CAND_QUANTUM_SHIFT;
+    if (q > 0xffff) {
+        q = 0xffff;
+    }
+    if (c->count < 0xff) {
+        c->count++;
+    }
+    c->mean += ((int32_t) q - (int32_t) c->mean) / (int32_t) c->count;
+    c->flags |= CAND_TESTED;
+}
+
+static inline uint32_t cand_mean(const candidate_t *c)
+{
+    return (uint32_t) c->mean << CAND_QUANTUM_SHIFT;
+}
+
+// Allocates room for max_candidates with sdram_alloc. Returns false if
+// there isn't room.
+bool candset_init(candset_t *set, uint32_t max_candidates);
+
+candidate_t *candset_find(const candset_t *set, cand_name_t name);
+
+// Returns the existing candidate, or a new one with zeroed statistics.
+// Returns null when the set is full.
+candidate_t *candset_insert(candset_t *set, cand_name_t name);
+
+// Iterate with index from 0 to candset_slots(); empty slots return null
+static inline uint32_t candset_slots(const candset_t *set)
+{
+    return set->capacity ? set->mask + 1 : 0;
+}
+
+static inline candidate_t *candset_slot(const candset_t *set, uint32_t index)
+{
+    candidate_t *c = &set->slots[index];
+    return (c->flags & CAND_USED) ? c : 0;
+}
+
+#endif // _CANDIDATE_H
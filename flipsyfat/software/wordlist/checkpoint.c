@@ -0,0 +1,274 @@
+// Save and restore a wordlist run across board resets
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <uart.h>
+#include <time.h>
+#include <crc.h>
+#include <generated/csr.h>
+#ifdef CSR_SPIFLASH_BASE
+#include <spiflash.h>
+#endif
+
+#include "checkpoint.h"
+
+#define RESUME_PREFIX "RESUME "
+
+static checkpoint_t ckpt;
+static uint32_t ckpt_seq;
+
+_Static_assert(sizeof(checkpoint_t) <= CKPT_FLASH_SLOT_B - CKPT_FLASH_SLOT_A,
+    "checkpoint doesn't fit a flash slot");
+
+
+static uint32_t ckpt_crc(const checkpoint_t *c)
+{
+    return crc32((const unsigned char*) c, offsetof(checkpoint_t, crc));
+}
+
+static bool ckpt_valid(const checkpoint_t *c)
+{
+    return c->magic == CKPT_MAGIC &&
+        c->version == CKPT_VERSION &&
+        c->num_pending <= QUEUE_SIZE &&
+        c->num_outliers <= OUTLIER_POOL_SIZE &&
+        c->crc == ckpt_crc(c);
+}
+
+#ifdef CSR_SPIFLASH_BASE
+
+// The memory-mapped window only covers the boot image, so read
+// checkpoints back through the same bitbang port libbase writes with.
+
+#define FLASH_READ_CMD      0x03
+#define BITBANG_CLK         (1 << 1)
+#define BITBANG_CS_N        (1 << 2)
+#define BITBANG_DQ_INPUT    (1 << 3)
+
+#ifdef SPIFLASH_SECTOR_SIZE
+#define FLASH_ERASE_SIZE    SPIFLASH_SECTOR_SIZE
+#else
+#define FLASH_ERASE_SIZE    4096
+#endif
+
+static void flash_out_byte(uint8_t b)
+{
+    for (int i = 0; i < 8; i++, b <<= 1) {
+        spiflash_bitbang_write((b & 0x80) >> 7);
+        spiflash_bitbang_write(((b & 0x80) >> 7) | BITBANG_CLK);
+    }
+}
+
+static uint8_t flash_in_byte(void)
+{
+    uint8_t b = 0;
+    for (int i = 0; i < 8; i++) {
+        spiflash_bitbang_write(BITBANG_DQ_INPUT);
+        spiflash_bitbang_write(BITBANG_DQ_INPUT | BITBANG_CLK);
+        b = (b << 1) | (spiflash_miso_read() & 1);
+    }
+    return b;
+}
+
+static void flash_read(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    spiflash_bitbang_en_write(1);
+    spiflash_bitbang_write(0);
+    flash_out_byte(FLASH_READ_CMD);
+    flash_out_byte(addr >> 16);
+    flash_out_byte(addr >> 8);
+    flash_out_byte(addr);
+    while (len--) {
+        *(buf++) = flash_in_byte();
+    }
+    spiflash_bitbang_write(BITBANG_CS_N);
+    spiflash_bitbang_en_write(0);
+}
+
+static uint32_t flash_slot(int i)
+{
+    return i ? CKPT_FLASH_SLOT_B : CKPT_FLASH_SLOT_A;
+}
+
+static void flash_save(const checkpoint_t *c)
+{
+    // Alternate slots, so the previous checkpoint survives a bad write
+    uint32_t addr = flash_slot(c->seq & 1);
+
+    for (uint32_t offset = 0; offset < sizeof *c; offset += FLASH_ERASE_SIZE) {
+        erase_flash_sector(addr + offset);
+    }
+    write_to_flash(addr, (const unsigned char*) c, sizeof *c);
+}
+
+static bool flash_load(checkpoint_t *c)
+{
+    bool found = false;
+    uint32_t best_seq = 0;
+
+    for (int i = 0; i < 2; i++) {
+        flash_read(flash_slot(i), (uint8_t*) c, sizeof *c);
+        if (ckpt_valid(c) && (!found || (int32_t)(c->seq - best_seq) > 0)) {
+            found = true;
+            best_seq = c->seq;
+        }
+    }
+
+    if (found) {
+        flash_read(flash_slot(best_seq & 1), (uint8_t*) c, sizeof *c);
+    }
+    return found;
+}
+
+#endif // CSR_SPIFLASH_BASE
+
+static int hex_value(char ch)
+{
+    switch (ch) {
+        case '0' ... '9':   return ch - '0';
+        case 'a' ... 'f':   return 10 + ch - 'a';
+        case 'A' ... 'F':   return 10 + ch - 'A';
+        default:            return -1;
+    }
+}
+
+// Wait for a RESUME line from the host
+static bool host_load(checkpoint_t *c)
+{
+    static const char prefix[] = RESUME_PREFIX;
+    uint8_t *dest = (uint8_t*) c;
+    uint32_t matched = 0;
+    uint32_t nybbles = 0;
+    int ts = 0;
+
+    elapsed(&ts, -1);
+    while (!elapsed(&ts, CKPT_RESUME_WAIT)) {
+        char ch;
+
+        if (!uart_read_nonblock()) {
+            continue;
+        }
+        ch = uart_read();
+
+        if (matched < sizeof prefix - 1) {
+            if (ch != prefix[matched++]) {
+                // Not a resume line, don't keep the user waiting
+                return false;
+            }
+            continue;
+        }
+
+        if (ch == '\r' || ch == '\n') {
+            return nybbles == 2 * sizeof *c && ckpt_valid(c);
+        }
+
+        if (hex_value(ch) < 0 || nybbles >= 2 * sizeof *c) {
+            return false;
+        }
+        if (nybbles & 1) {
+            dest[nybbles / 2] |= hex_value(ch);
+        } else {
+            dest[nybbles / 2] = hex_value(ch) << 4;
+        }
+        nybbles++;
+
+        // Don't time out partway through a line
+        elapsed(&ts, -1);
+    }
+    return false;
+}
+
+bool checkpoint_restore(void *enum_state, uint32_t len, bool (*enum_match)(const void *enum_state))
+{
+    const char *source = "host";
+
+    printf("Send " RESUME_PREFIX "<checkpoint> within %d seconds to continue a run\n",
+        CKPT_RESUME_WAIT / CONFIG_CLOCK_FREQUENCY);
+
+    if (!host_load(&ckpt)) {
+#ifdef CSR_SPIFLASH_BASE
+        source = "flash";
+        if (!flash_load(&ckpt))
+#endif
+        {
+            printf("No checkpoint, starting a new run\n");
+            return false;
+        }
+    }
+
+    // Saves from here on are newer, whether or not this one is used
+    ckpt_seq = ckpt.seq + 1;
+
+    if (enum_match && !enum_match(ckpt.enum_state)) {
+        printf("The %s checkpoint #%u is for another run, starting a new one\n",
+            source, (unsigned) ckpt.seq);
+        return false;
+    }
+
+    printf("Resuming from %s checkpoint #%u: %llu guesses, %u resets, %u pending, %u outliers\n",
+        source, (unsigned) ckpt.seq, (long long unsigned) ckpt.guesses_done,
+        (unsigned) ckpt.reset_counter, (unsigned) ckpt.num_pending, (unsigned) ckpt.num_outliers);
+
+    memcpy(enum_state, ckpt.enum_state, len < CKPT_ENUM_SIZE ? len : CKPT_ENUM_SIZE);
+    reset_counter = ckpt.reset_counter;
+    baseline = ckpt.baseline;
+    num_outliers = ckpt.num_outliers;
+    memcpy(outliers, ckpt.outliers, sizeof outliers);
+    guesser_restore(ckpt.guesses_done);
+
+    for (uint32_t i = 0; i < num_outliers; i++) {
+        char name[GUESS_FORMAT_LEN];
+        guess_format(name, sizeof name, &outliers[i]);
+        printf("Restored outlier rep=%d %s = %d\n",
+            outliers[i].replicate_count, name, outliers[i].measurement);
+    }
+
+    for (uint32_t i = 0; i < ckpt.num_pending; i++) {
+        guess_entry(&ckpt.pending[i]);
+    }
+    return true;
+}
+
+void checkpoint_save(const void *enum_state, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t*) &ckpt;
+
+    memset(&ckpt, 0, sizeof ckpt);
+    ckpt.magic = CKPT_MAGIC;
+    ckpt.version = CKPT_VERSION;
+    ckpt.seq = ckpt_seq++;
+    ckpt.reset_counter = reset_counter;
+    ckpt.guesses_done = qptr_read_measurement;
+    ckpt.baseline = baseline;
+    memcpy(ckpt.enum_state, enum_state, len < CKPT_ENUM_SIZE ? len : CKPT_ENUM_SIZE);
+    ckpt.num_pending = guesser_pending(ckpt.pending);
+    ckpt.num_outliers = num_outliers;
+    memcpy(ckpt.outliers, outliers, sizeof outliers);
+    ckpt.crc = ckpt_crc(&ckpt);
+
+    printf("CKPT ");
+    for (uint32_t i = 0; i < sizeof ckpt; i++) {
+        printf("%02x", p[i]);
+    }
+    printf("\n");
+
+#ifdef CSR_SPIFLASH_BASE
+    flash_save(&ckpt);
+#endif
+}
+
+void checkpoint_poll(const void *enum_state, uint32_t len)
+{
+    // Period is longer than elapsed() can count directly
+    static int last_second = 0;
+    static uint32_t seconds = 0;
+
+    if (elapsed(&last_second, CONFIG_CLOCK_FREQUENCY) && ++seconds >= CKPT_PERIOD_SECONDS) {
+        seconds = 0;
+        checkpoint_save(enum_state, len);
+    }
+}
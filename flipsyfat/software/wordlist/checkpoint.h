@@ -0,0 +1,57 @@
+// Save and restore a wordlist run across board resets
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fat.h"
+#include "guesser.h"
+
+// A checkpoint holds the enumerator position (opaque to this module), the
+// guesses still in flight, the outlier pool, baseline statistics and the
+// reset counter. Every CKPT_PERIOD_SECONDS it's printed as one "CKPT <hex>" line,
+// and written to SPI flash when the SoC has a writable one, alternating
+// between two slots so a failed write leaves the older copy intact.
+//
+// At startup the board waits CKPT_RESUME_WAIT for a "RESUME <hex>" line
+// with the contents of a logged CKPT line, then falls back to the newest
+// valid flash slot. Any other input skips the wait.
+
+#define CKPT_MAGIC          0x46534350      // "FSCP"
+#define CKPT_VERSION        3
+#define CKPT_ENUM_SIZE      32
+#define CKPT_PERIOD_SECONDS 600
+#define CKPT_RESUME_WAIT    (CONFIG_CLOCK_FREQUENCY * 5)
+
+// Top of the 8 MB configuration flash, a 64 kB block each
+#define CKPT_FLASH_SLOT_A   0x7e0000
+#define CKPT_FLASH_SLOT_B   0x7f0000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t reset_counter;
+    qptr_t guesses_done;
+    baseline_t baseline;
+    uint8_t enum_state[CKPT_ENUM_SIZE];
+    uint32_t num_pending;
+    uint32_t num_outliers;
+    queue_entry pending[QUEUE_SIZE];
+    queue_entry outliers[OUTLIER_POOL_SIZE];
+    uint32_t crc;   // Of everything above
+} checkpoint_t;
+
+// Returns true and fills 'enum_state' if a checkpoint was restored.
+// Pending guesses are requeued before it returns. A checkpoint that
+// 'enum_match' (if not null) turns down, given its enumerator position as
+// saved and maybe unaligned, is skipped whole and nothing is restored.
+bool checkpoint_restore(void *enum_state, uint32_t len, bool (*enum_match)(const void *enum_state));
+
+// Call between guesses; saves when one is due
+void checkpoint_poll(const void *enum_state, uint32_t len);
+void checkpoint_save(const void *enum_state, uint32_t len);
+
+#endif // _CHECKPOINT_H
@@ -15,59 +15,108 @@
 #include "sdemu.h"
 #include "fat.h"
 #include "sdtimer.h"
+#include "reset.h"
+#include "sdclock.h"
+#include "edgecap.h"
+#include "profile.h"
+#include "metrics.h"
+#include "hot.h"
+#include "bh.h"
 #include "guesser.h"
 
-#define NORMAL_CLKOUT_DIV 16
-static const uint32_t normal_measurement_low = 2120 * NORMAL_CLKOUT_DIV;
-static const uint32_t normal_measurement_high = 2160 * NORMAL_CLKOUT_DIV;
+#define NORMAL_CLKOUT_DIV RESET_CLKOUT_DIV
+static uint32_t normal_window_low = 2120 * NORMAL_CLKOUT_DIV;
+static uint32_t normal_window_high = 2160 * NORMAL_CLKOUT_DIV;
 static const uint32_t max_replicate_count = 32;
 
-static const uint32_t reset_gpio_mask = 1 << 0;
+// The window above, moved by drift the controls measure
+static uint32_t normal_measurement_low = 2120 * NORMAL_CLKOUT_DIV;
+static uint32_t normal_measurement_high = 2160 * NORMAL_CLKOUT_DIV;
 
 static const uint32_t watchdog_period = CONFIG_CLOCK_FREQUENCY * 4;
 static const uint32_t status_period = CONFIG_CLOCK_FREQUENCY / 2;
-static const uint32_t reset_low_len = CONFIG_CLOCK_FREQUENCY / 10;
 static const uint32_t reset_high_len = CONFIG_CLOCK_FREQUENCY / 10;
 
-static uint32_t reset_counter;
-static uint32_t reset_ts;
-static bool reset_pending = false;
-static bool timer_armed = false;
+uint32_t reset_counter;
+baseline_t baseline = { .min = (uint32_t) -1 };
+control_stats_t control_stats[GUESS_CONTROL_KINDS];
+
+// First tries of normal guesses, usual or not; weight 1/16
+static int32_t normal_ewma;
+static uint32_t normal_results;
+static uint32_t guesses_since_control;
+static uint32_t next_control_kind = GUESS_CONTROL_DELETED;
+static bool channel_degraded;
+
+// Results left to average quickly after the SD clock changed speed, and
+// the data transfer speed it changed to; 0 until the first
+static uint32_t clock_settling;
+static uint32_t clock_khz;
+queue_entry outliers[OUTLIER_POOL_SIZE];
+uint32_t num_outliers;
+candset_t guess_candidates;
 
-queue_entry queue[QUEUE_SIZE];
-volatile qptr_t qptr_write_guess;
-volatile qptr_t qptr_read_guess;
-volatile qptr_t qptr_write_measurement;
-volatile qptr_t qptr_read_measurement;
+static bool reset_pending = false;
+static bool auto_reset = false;
+static volatile bool timer_armed = false;
+
+static bool in_subdir = false;
+static uint8_t subdir_entry[FAT_DENTRY_SIZE] HOT_DATA;
+static bool per_scan = false;
+static bool log_results = false;
+
+// Edge timing: capture pins the victim toggles, and whether the normal
+// window is still to be learned from them
+static uint32_t edge_pins;
+static bool window_learning = false;
+
+static guess_ring_t guesses;           // Main loop to ISR
+static guess_ring_t results;           // ISR to main loop, with measurements
+qptr_t qptr_write_guess;
+qptr_t qptr_read_measurement;
+
+// ISR only: the guess being presented, and the one presented before it,
+// waiting for its measurement. The rings are too big for SRAM.
+static queue_entry current HOT_DATA;
+static queue_entry timed HOT_DATA;
+static bool current_valid;
+static bool timed_valid;
+
+
+// Per-scan mode: a new guess goes up between scans. One still here never
+// got its measurement, likely because the victim stopped early, which is
+// unusual in itself; a zero measurement gets it requeued.
+static void next_scan_guess(void)
+{
+    if (current_valid) {
+        current.measurement = 0;
+        guess_ring_push(&results, &current);
+    }
+    current_valid = guess_ring_pop(&guesses, &current);
 
+    // The template is a single dentry, long names stay in software
+    fat_synth_root(current_valid && guess_slots(&current) == 1 ? current.guess : 0);
+}
 
-void reset_pulse(void)
+// Everything a reset means to the experiment, short of doing it
+static void reset_bookkeeping(void)
 {
-    int ts = 0;
-
     reset_counter++;
     timer_armed = false;
     reset_pending = false;
-    elapsed(&ts, -1);
-
-    // Hold SD emulator in reset
-    sdemu_reset_write(1);
 
-    // Drive reset low, stop clock
-    gpio_out_write(gpio_out_read() & ~reset_gpio_mask);
-    gpio_oe_write(gpio_oe_read() | reset_gpio_mask);
-    clkout_div_write(0);
-    while (!elapsed(&ts, reset_low_len));
-
-    // Start clock, emulator, release reset
-    clkout_div_write(NORMAL_CLKOUT_DIV);
-    sdemu_reset_write(0);
-    gpio_oe_write(gpio_oe_read() & ~reset_gpio_mask);
+    if (per_scan && !in_subdir) {
+        unsigned int ie = irq_getie();
+        irq_setie(0);
+        next_scan_guess();
+        irq_setie(ie);
+    }
+}
 
-    // Another delay, then capture a fresh reset timestamp
-    while (!elapsed(&ts, reset_high_len));
-    sdtimer_capture_write(0);
-    reset_ts = sdtimer_capture_ts_read();
+void reset_pulse(void)
+{
+    reset_bookkeeping();
+    reset_start(reset_high_len);
 }
 
 void mainloop_poll(void)
@@ -76,41 +125,299 @@ void mainloop_poll(void)
 
     static int last_event = 0;
     uint32_t now, rdts;
+    sdclock_t clock;
 
     sdtimer_capture_write(0);
     now = sdtimer_capture_ts_read();
     rdts = sdtimer_read_ts_read();
 
-    if ((int32_t)(now - rdts) > watchdog_period &&
-        (int32_t)(now - reset_ts) > watchdog_period) {
-        printf("Experiment seems stuck, resetting target.\n");
-        reset_pending = true;
+    // A reset still in progress has no timestamp yet
+    if (!reset_busy()) {
+        uint32_t reset_ts = reset_timestamp();
+
+        if ((int32_t)(now - rdts) > watchdog_period &&
+            (int32_t)(now - reset_ts) > watchdog_period) {
+            printf("Experiment seems stuck, resetting target.\n");
+            reset_pending = true;
+        }
+
+        if (reset_pending && (int32_t)(now - reset_ts) > watchdog_period) {
+            reset_pulse();
+        }
     }
 
-    if (reset_pending && (int32_t)(now - reset_ts) > watchdog_period) {
-        reset_pulse();
+    // Each reset drops to the identification clock and comes back; only
+    // a new data transfer speed is news
+    if (sdclock_changed(&clock) && !sdclock_init_speed(clock.khz) &&
+        !sdclock_same_speed(clock.khz, clock_khz)) {
+        printf("SD clock %u kHz, period %u-%u cycles, ts=%08x\n",
+            (unsigned) clock.khz, (unsigned) clock.period_min, (unsigned) clock.period_max,
+            (unsigned) clock.ts);
+
+        // Every measurement moves with the new speed; let the controls
+        // and the normal level catch up in a few results, not dozens
+        if (clock_khz) {
+            clock_settling = GUESS_CONTROL_CALIBRATION;
+        }
+        clock_khz = clock.khz;
+    }
+
+    bh_run();
+    profile_emit(false);
+    metrics_poll(qptr_write_guess - qptr_read_measurement);
+
+    // The one place that reads console input once the run is going; more
+    // commands would chain after this one
+    if (uart_read_nonblock()) {
+        metrics_command(uart_read());
     }
 
     // Status
     if (elapsed(&last_event, status_period)) {
-        uint8_t *name = qentry(qptr_read_guess)->guess;
-        printf("Trying [%.8s.%.3s] qptr (%06x-%06x-%06x-%06x) rst=%d ",
-            name, name+8,
+        char name[GUESS_FORMAT_LEN];
+        queue_entry shown;
+        unsigned int ie = irq_getie();
+
+        irq_setie(0);
+        shown = current;
+        irq_setie(ie);
+
+        // Ring indices count from the last restore
+        guess_format(name, sizeof name, &shown);
+        printf("Trying %s qptr (%06x-%06x-%06x-%06x) rst=%d ctl=%d%% drift=%d ",
+            name,
             (unsigned)(qptr_write_guess & 0xffffff),
-            (unsigned)(qptr_read_guess & 0xffffff),
-            (unsigned)(qptr_write_measurement & 0xffffff),
+            (unsigned)(guesses.tail & 0xffffff),
+            (unsigned)(results.head & 0xffffff),
             (unsigned)(qptr_read_measurement & 0xffffff),
-            reset_counter);
+            reset_counter, guesser_channel_health(), (int) guesser_drift());
         sdemu_status();
     }
 }
 
+static uint32_t deviation(uint32_t measurement)
+{
+    if (measurement < normal_measurement_low) return normal_measurement_low - measurement;
+    if (measurement > normal_measurement_high) return measurement - normal_measurement_high;
+    return 0;
+}
+
+static void record_outlier(const queue_entry *entry)
+{
+    uint32_t slot = num_outliers;
+
+    if (num_outliers == OUTLIER_POOL_SIZE) {
+        // Full; replace the least interesting one if this is more deviant
+        slot = 0;
+        for (uint32_t i = 1; i < OUTLIER_POOL_SIZE; i++) {
+            if (deviation(outliers[i].measurement) < deviation(outliers[slot].measurement)) {
+                slot = i;
+            }
+        }
+        if (deviation(outliers[slot].measurement) >= deviation(entry->measurement)) {
+            return;
+        }
+    } else {
+        num_outliers++;
+    }
+    outliers[slot] = *entry;
+}
+
+static void record_baseline(uint32_t measurement)
+{
+    baseline.count++;
+    baseline.sum += measurement;
+    if (measurement < baseline.min) baseline.min = measurement;
+    if (measurement > baseline.max) baseline.max = measurement;
+}
+
+// Weight of a new result in the averages that follow the channel
+static int32_t ewma_divisor(void)
+{
+    return clock_settling ? 2 : 16;
+}
+
+static void record_normal_level(const queue_entry *entry)
+{
+    // Retries would weigh it towards the outliers
+    if (entry->measurement && !entry->replicate_count) {
+        if (normal_results++ == 0) {
+            normal_ewma = entry->measurement;
+        } else {
+            normal_ewma += ((int32_t) entry->measurement - normal_ewma) / ewma_divisor();
+        }
+        if (window_learning && normal_results == GUESS_CONTROL_CALIBRATION) {
+            // Same width, around the level edge timing found
+            uint32_t half = (normal_window_high - normal_window_low) / 2;
+            normal_window_low = normal_ewma - half;
+            normal_window_high = normal_ewma + half;
+            normal_measurement_low = normal_window_low + guesser_drift();
+            normal_measurement_high = normal_window_high + guesser_drift();
+            window_learning = false;
+            printf("Edge timing: normal window %u-%u\n",
+                (unsigned) normal_window_low, (unsigned) normal_window_high);
+        }
+    }
+}
+
+// Kinds whose controls were clearly faster or slower than normal guesses
+static bool control_usable(const control_stats_t *c)
+{
+    return c->results > GUESS_CONTROL_CALIBRATION &&
+        abs(c->separation) >= GUESS_CONTROL_MIN_SEPARATION;
+}
+
+int guesser_channel_health(void)
+{
+    int best = -1;
+
+    for (int i = 0; i < GUESS_CONTROL_KINDS; i++) {
+        const control_stats_t *c = &control_stats[i];
+        if (control_usable(c)) {
+            int health = (int64_t)(normal_ewma - c->ewma) * 100 / c->separation;
+            if (health > best) best = health;
+        }
+    }
+    return best;
+}
+
+int32_t guesser_drift(void)
+{
+    // From the first usable kind, in order of how reliably victims skip it
+    for (int i = 0; i < GUESS_CONTROL_KINDS; i++) {
+        const control_stats_t *c = &control_stats[i];
+        if (control_usable(c)) {
+            return c->ewma - c->reference;
+        }
+    }
+    return 0;
+}
+
+void guesser_normal_window(uint32_t *low, uint32_t *high)
+{
+    *low = normal_measurement_low;
+    *high = normal_measurement_high;
+}
+
+static void record_control(const queue_entry *entry)
+{
+    control_stats_t *c = &control_stats[entry->kind - 1];
+    int32_t measurement = entry->measurement;
+
+    if (!measurement) {
+        // Not worth a retry, there'll be another along shortly
+        c->missed++;
+        metrics.skipped++;
+        return;
+    }
+
+    if (c->results < GUESS_CONTROL_CALIBRATION && normal_results < GUESS_CONTROL_CALIBRATION) {
+        // Nothing to calibrate against yet
+        return;
+    }
+
+    c->results++;
+    if (c->results <= GUESS_CONTROL_CALIBRATION) {
+        c->calibration_sum += measurement;
+        if (c->results == GUESS_CONTROL_CALIBRATION) {
+            c->reference = c->calibration_sum / GUESS_CONTROL_CALIBRATION;
+            c->separation = normal_ewma - c->reference;
+            c->ewma = c->reference;
+        }
+        return;
+    }
+    c->ewma += (measurement - c->ewma) / ewma_divisor();
+    if (clock_settling) {
+        clock_settling--;
+    }
+
+    int32_t drift = guesser_drift();
+    normal_measurement_low = normal_window_low + drift;
+    normal_measurement_high = normal_window_high + drift;
+
+    int health = guesser_channel_health();
+    if (health >= 0 && (health < GUESS_CONTROL_WARN_PERCENT) != channel_degraded) {
+        channel_degraded = !channel_degraded;
+        printf("Control experiments: channel %s, separation %d%% drift %d\n",
+            channel_degraded ? "DEGRADED" : "recovered", health, (int) drift);
+    }
+}
+
+static void make_control(queue_entry *control, const queue_entry *entry, uint32_t kind)
+{
+    *control = *entry;
+    control->kind = kind;
+    control->measurement = 0;
+    control->replicate_count = 0;
+
+    if (kind == GUESS_CONTROL_DELETED) {
+        for (uint32_t i = 0; i < guess_slots(control); i++) {
+            control->guess[i * FAT_DENTRY_SIZE] = 0xe5;
+        }
+    } else {
+        control->guess[(guess_slots(control) - 1) * FAT_DENTRY_SIZE + 0x0b] = 0x08;
+    }
+}
+
+static void track_candidate(const queue_entry *entry, bool unusual)
+{
+    cand_name_t name;
+    candidate_t *c;
+
+    // Skipped measurements say nothing about the name
+    if (!entry->measurement || !cand_pack(&name, guess_short_entry(entry))) {
+        return;
+    }
+    // Once normal results have most of the room, keep the rest for outliers
+    c = candset_find(&guess_candidates, name);
+    if (!c && (unusual || guess_candidates.count < guess_candidates.capacity / 8 * 7)) {
+        c = candset_insert(&guess_candidates, name);
+    }
+    if (c) {
+        cand_record(c, entry->measurement);
+        if (unusual) {
+            c->flags |= CAND_OUTLIER;
+        }
+    }
+}
+
+// One line per result for host-side analysis, in hex:
+//   R kind replicate_count measurement packed-name
+// with name 0 where the short name doesn't pack
+static void log_result(const queue_entry *entry)
+{
+    cand_name_t name = 0;
+
+    cand_pack(&name, guess_short_entry(entry));
+    printf("R %x %x %x %llx\n", entry->kind, entry->replicate_count,
+        (unsigned) entry->measurement, (unsigned long long) name);
+}
+
 static void dequeue_results(void)
 {
-    while (qptr_read_measurement != qptr_write_measurement) {
-        uint32_t measurement = qentry(qptr_read_measurement)->measurement;    
+    while (guess_ring_count(&results)) {
+        queue_entry *result = guess_ring_peek(&results, 0);
+        uint32_t measurement = result->measurement;
+        bool unusual;
+
+        if (log_results) {
+            log_result(result);
+        }
 
-        if (measurement < normal_measurement_low || measurement > normal_measurement_high) {
+        if (result->kind != GUESS_NORMAL) {
+            record_control(result);
+            guess_ring_release(&results, 1);
+            qptr_read_measurement++;
+            continue;
+        }
+        record_normal_level(result);
+        if (!measurement) {
+            metrics.skipped++;
+        }
+        unusual = !window_learning &&
+            (measurement < normal_measurement_low || measurement > normal_measurement_high);
+
+        if (unusual) {
             // Unusual! Replicate this measurement to be sure
 
             if ((qptr_write_guess - qptr_read_measurement) > QUEUE_SIZE - 1) {
@@ -118,26 +425,39 @@ static void dequeue_results(void)
                 return;
             }
 
-            printf("Unusual RESULT #%llu rep=%d [%.8s.%.3s] = %d\n",
+            char name[GUESS_FORMAT_LEN];
+            guess_format(name, sizeof name, result);
+            printf("Unusual RESULT #%llu rep=%d %s = %d\n",
                 (long long unsigned) qptr_read_measurement,
-                qentry(qptr_read_measurement)->replicate_count,
-                qentry(qptr_read_measurement)->guess,
-                qentry(qptr_read_measurement)->guess + 8,
-                measurement);
+                result->replicate_count,
+                name, measurement);
+
+            if (measurement) {
+                record_outlier(result);
+            }
 
-            if (qentry(qptr_read_measurement)->replicate_count + 1 < max_replicate_count) {
+            if (result->replicate_count + 1 < max_replicate_count) {
                 // Replicate this experiment
-                memcpy(qentry(qptr_write_guess)->guess, qentry(qptr_read_measurement)->guess, FAT_DENTRY_SIZE);
-                qentry(qptr_write_guess)->replicate_count = qentry(qptr_read_measurement)->replicate_count + 1;
+                queue_entry *retry = guess_ring_slot(&guesses, 0);
+                *retry = *result;
+                retry->replicate_count++;
+                guess_ring_commit(&guesses, 1);
                 qptr_write_guess++;
+                metrics.replicas++;
             }
+        } else {
+            record_baseline(measurement);
         }
 
+        track_candidate(result, unusual);
+        guess_result(result);
+        metrics.results++;
+        guess_ring_release(&results, 1);
         qptr_read_measurement++;
     }
 }
 
-void guess_dentry(const uint8_t *dentry)
+static void enqueue(const queue_entry *entry)
 {
     // Keep the queue half full of normal guesses, leaving room for retries.
     do {
@@ -145,11 +465,104 @@ void guess_dentry(const uint8_t *dentry)
         dequeue_results();
     } while ((qptr_write_guess - qptr_read_measurement) > QUEUE_SIZE / 2);
 
-    memcpy(qentry(qptr_write_guess)->guess, dentry, FAT_DENTRY_SIZE);
-    qentry(qptr_write_guess)->replicate_count = 0;
+    guess_ring_push(&guesses, entry);
     qptr_write_guess++;
 }
 
+void guess_entry(const queue_entry *entry)
+{
+    enqueue(entry);
+
+    if (entry->kind == GUESS_NORMAL && ++guesses_since_control == GUESS_CONTROL_PERIOD) {
+        queue_entry control;
+        make_control(&control, entry, next_control_kind);
+        guesses_since_control = 0;
+        next_control_kind = next_control_kind % GUESS_CONTROL_KINDS + 1;
+        enqueue(&control);
+    }
+}
+
+void guess_dentries(const uint8_t *dentries, unsigned count)
+{
+    queue_entry entry;
+    unsigned slots = 1;
+
+    while (slots < count) {
+        slots <<= 1;
+    }
+
+    memset(entry.guess, 0, sizeof entry.guess);
+    for (unsigned i = 0; i < slots - count; i++) {
+        entry.guess[i * FAT_DENTRY_SIZE] = 0xe5;
+    }
+    memcpy(entry.guess + (slots - count) * FAT_DENTRY_SIZE, dentries, count * FAT_DENTRY_SIZE);
+    entry.num_slots = slots;
+    entry.kind = GUESS_NORMAL;
+    entry.measurement = 0;
+    entry.replicate_count = 0;
+    guess_entry(&entry);
+}
+
+void guess_dentry(const uint8_t *dentry)
+{
+    guess_dentries(dentry, 1);
+}
+
+uint32_t guesser_pending(queue_entry *dest)
+{
+    uint32_t count = 0;
+    unsigned int ie = irq_getie();
+
+    // Everything in flight, oldest first: unread results, the ISR's two
+    // copies, then guesses it hasn't taken yet
+    irq_setie(0);
+    for (uint32_t i = 0; i < guess_ring_count(&results); i++) {
+        dest[count++] = *guess_ring_peek(&results, i);
+    }
+    if (timed_valid) {
+        dest[count++] = timed;
+    }
+    if (current_valid) {
+        dest[count++] = current;
+    }
+    for (uint32_t i = 0; i < guess_ring_count(&guesses); i++) {
+        dest[count++] = *guess_ring_peek(&guesses, i);
+    }
+    irq_setie(ie);
+
+    for (uint32_t i = 0; i < count; i++) {
+        dest[i].measurement = 0;
+    }
+    return count;
+}
+
+void guesser_restore(qptr_t done)
+{
+    unsigned int ie = irq_getie();
+    irq_setie(0);
+    qptr_write_guess = done;
+    qptr_read_measurement = done;
+    guess_ring_init(&guesses);
+    guess_ring_init(&results);
+    current_valid = false;
+    timed_valid = false;
+    timer_armed = false;
+    fat_synth_root(0);
+    irq_setie(ie);
+}
+
+void guess_packed(cand_name_t name)
+{
+    uint8_t unpacked[CAND_NAME_LEN];
+    cand_unpack(unpacked, name);
+    guess_filename((const char *) unpacked, (const char *) unpacked + 8);
+}
+
+bool guesser_track_candidates(uint32_t max)
+{
+    return candset_init(&guess_candidates, max);
+}
+
 void guess_filename(const char *name, const char *ext)
 {
     uint8_t dentry[FAT_DENTRY_SIZE];
@@ -157,54 +570,283 @@ void guess_filename(const char *name, const char *ext)
     guess_dentry(dentry);
 }
 
-void fat_rootdir_entry(uint8_t* dest, unsigned index)
+void guess_long_filename(const char *long_name, const char *name, const char *ext)
 {
-    unsigned offset = index % FAT_DENTRY_PER_SECTOR;
+    uint8_t dentries[FAT_DENTRY_SIZE * GUESS_MAX_DENTRIES];
+    unsigned count = fat_long_file(dentries, long_name, name, ext, 0x100, 0x10000,
+        GUESS_MAX_DENTRIES - 1);
+    guess_dentries(dentries, count);
+}
 
-    if (index == 0) {
-        // Volume label is special
-        fat_volume_label(dest);
+int guess_format(char *buf, int size, const queue_entry *entry)
+{
+    const uint8_t *short_entry = guess_short_entry(entry);
+    char long_name[GUESS_LFN_MAX_CHARS + 1];
+    unsigned len = 0;
+
+    // LFN parts sit just before the short entry, the first part closest
+    for (const uint8_t *lfn = short_entry - FAT_DENTRY_SIZE;
+         lfn >= entry->guess && lfn[0x0b] == 0x0f; lfn -= FAT_DENTRY_SIZE) {
+        len += fat_lfn_chars(long_name + len, lfn);
+    }
+    long_name[len] = '\0';
+
+    if (len) {
+        return snprintf(buf, size, "[%.8s.%.3s] {%s}", short_entry, short_entry + 8, long_name);
+    }
+    return snprintf(buf, size, "[%.8s.%.3s]", short_entry, short_entry + 8);
+}
+
+// Sectors the victim reads the experiment from
+static void experiment_sectors(uint32_t *first, uint32_t *last)
+{
+    if (in_subdir) {
+        *first = FAT_DATA_START + (GUESS_SUBDIR_CLUSTER - 2) * FAT_CLUSTER_SIZE;
+        *last = *first + GUESS_SUBDIR_SECTORS - 1;
     } else {
-        // Replicated copy of this sector's experiment
-        memcpy(dest, qentry(qptr_read_guess)->guess, FAT_DENTRY_SIZE);
+        *first = FAT_ROOT_START;
+        *last = FAT_ROOT_END;
+    }
+}
 
-#if 0   // Control experiment; all files starting with 'D' should take less time
-        if (dest[0] == 'D') {
-            dest[0xb] = 0x8;
-        }
-#endif
+void guesser_set_subdir(const char *name, const char *ext)
+{
+    in_subdir = name != 0;
+    if (in_subdir) {
+        fat_subdir_entry(subdir_entry, name, ext, GUESS_SUBDIR_CLUSTER);
+        fat_chain_first = GUESS_SUBDIR_CLUSTER;
+        fat_chain_last = GUESS_SUBDIR_CLUSTER + GUESS_SUBDIR_CLUSTERS - 1;
+    } else {
+        fat_chain_first = 0;
+        fat_chain_last = 0;
     }
 
-    // First entry in sector; measure processing time if the timer was armed
-    if (offset == 0 && timer_armed) {
-        qentry(qptr_write_measurement)->measurement = sdtimer_read_ts_read() - sdtimer_done_ts_read();
-        qptr_write_measurement++;
+    // Measurements and per-scan template swaps belong to the victim's
+    // request, not to a read-ahead a block earlier
+    uint32_t first, last;
+    experiment_sectors(&first, &last);
+    sdemu_no_prefetch(first, last);
+
+    // Nor does the victim get to freeze them by writing back the directory
+    fat_overlay_exclude(FAT_ROOT_START, last);
+}
+
+void guesser_log_results(bool enable)
+{
+    log_results = enable;
+}
+
+void guesser_set_per_scan(bool enable)
+{
+    per_scan = enable;
+    if (!enable) {
+        fat_synth_root(0);
+    }
+}
+
+// Last record; reset target to continue the experiment. The sequencer
+// does that by itself once this sector has gone out, so only the
+// bookkeeping is left, and per-scan mode has the next guess up in time.
+static void last_entry(void)
+{
+    if (auto_reset) {
+        reset_counter++;
+        timer_armed = false;
+        if (per_scan && !in_subdir) {
+            next_scan_guess();
+        }
+    } else {
+        reset_pending = true;
         timer_armed = false;
     }
+}
+
+bool guesser_set_auto_reset(bool enable)
+{
+    uint32_t first, last;
+
+    experiment_sectors(&first, &last);
+    auto_reset = reset_auto(enable, last) && enable;
+    return auto_reset;
+}
+
+bool guesser_set_edge_timing(uint32_t pins)
+{
+    if (!edgecap_enable(pins, pins)) {
+        return false;
+    }
+    edge_pins = pins;
+    window_learning = pins != 0;
+    return true;
+}
+
+// Victim's time on the block that went out last: until it asked for the
+// next one, or with edge timing, until its first edge on one of the pins
+// after. No such edge yet makes it a skipped measurement.
+static uint32_t measure(void)
+{
+    uint32_t done = sdtimer_done_ts_read();
+    edgecap_event_t event;
+
+    if (!edge_pins) {
+        return sdtimer_read_ts_read() - done;
+    }
+    while (edgecap_pop(&event)) {
+        if ((event.edges & edge_pins) && (int32_t)(event.ts - done) > 0) {
+            return event.ts - done;
+        }
+    }
+    return 0;
+}
+
+// Replicated copy of this sector's experiment
+static void guess_slot(uint8_t *dest, unsigned index)
+{
+    memcpy(dest, current.guess + (index % guess_slots(&current)) * FAT_DENTRY_SIZE, FAT_DENTRY_SIZE);
+}
+
+// Bookkeeping for a scan that presents 'current' in every sector. The
+// synthesizer may have served all but the last; this one is ours either way.
+static void scan_experiment_entry(unsigned index)
+{
+    if (index == 0 && !current_valid) {
+        // Nothing went up at the last reset, start here instead
+        next_scan_guess();
+    }
+
+    if (index == FAT_MAX_ROOT_ENTRIES - FAT_DENTRY_PER_SECTOR && current_valid) {
+        // Measure the victim's pass over the sector before this one
+        current.measurement = measure();
+        guess_ring_push(&results, &current);
+        current_valid = false;
+    }
 
     if (index == FAT_MAX_ROOT_ENTRIES - 1) {
-        // Last record; reset target to continue the experiment
-        reset_pending = true;
+        last_entry();
+    }
+}
+
+// Timing and queue bookkeeping, for entry 'index' of the experiment's
+// directory which has 'num_entries' in all
+static void experiment_entry(unsigned index, unsigned num_entries)
+{
+    unsigned offset = index % FAT_DENTRY_PER_SECTOR;
+
+    if (per_scan && !in_subdir) {
+        scan_experiment_entry(index);
+        return;
+    }
+
+    if (index == 0 && !current_valid) {
+        // Nothing up yet after start-up or a restore. Entry 0 is the
+        // label or a dot entry; the rest of the sector shows this one.
+        current_valid = guess_ring_pop(&guesses, &current);
+    }
+
+    // First entry in sector; measure processing time if the timer was armed.
+    // The results ring can't fill, it has room for everything in flight.
+    if (offset == 0 && timer_armed) {
+        timed.measurement = measure();
+        guess_ring_push(&results, &timed);
+        timed_valid = false;
         timer_armed = false;
+    }
+
+    if (index == num_entries - 1) {
+        last_entry();
 
-    } else if (offset == FAT_DENTRY_PER_SECTOR - 1 && qptr_read_guess + 1 < qptr_write_guess) {
+    } else if (offset == FAT_DENTRY_PER_SECTOR - 1 && guess_ring_count(&guesses)) {
         // End of sector, more guesses available
 
-        while (qptr_write_measurement < qptr_read_guess) {
-            // Skipped masurements; main loop will requeue them, we can't write to that queue safely from the ISR.
-            qentry(qptr_write_measurement)->measurement = 0;
-            qptr_write_measurement++;
+        if (current_valid) {
+            if (timed_valid) {
+                // Skipped measurement; the main loop will requeue it
+                timed.measurement = 0;
+                guess_ring_push(&results, &timed);
+            }
+
+            // Start timing the current guess
+            timed = current;
+            timed_valid = true;
+            timer_armed = true;
         }
 
-        // Start timing the current guess
-        timer_armed = true;
         // Next guess
-        qptr_read_guess++;
+        guess_ring_pop(&guesses, &current);
+        current_valid = true;
     }
 }
 
+// Timing profile of the scan. With prefetch, a block is prepared while the
+// victim still reads the one before; the timestamps belong to that.
+static void profile_block(uint32_t lba)
+{
+    static uint32_t last_scan_reset = (uint32_t) -1;
+    cand_name_t name = 0;
+
+    if (reset_counter != last_scan_reset) {
+        last_scan_reset = reset_counter;
+        metrics.scans++;
+    }
+
+    if (per_scan && !in_subdir && current_valid) {
+        cand_pack(&name, guess_short_entry(&current));
+    }
+    profile_sample(sdemu_prefetching ? lba - 1 : lba, reset_counter, name);
+}
+
+void fat_rootdir_entry(uint8_t* dest, unsigned index)
+{
+    if (index % FAT_DENTRY_PER_SECTOR == 0) {
+        profile_block(FAT_ROOT_START + index / FAT_DENTRY_PER_SECTOR);
+    }
+
+    if (in_subdir) {
+        // Just the way in; the directory ends after it
+        memset(dest, 0, FAT_DENTRY_SIZE);
+        if (index == 0) {
+            fat_volume_label(dest);
+        } else if (index == 1) {
+            memcpy(dest, subdir_entry, FAT_DENTRY_SIZE);
+        }
+        return;
+    }
+
+    if (index == 0) {
+        // Volume label is special
+        fat_volume_label(dest);
+    } else {
+        guess_slot(dest, index);
+    }
+    experiment_entry(index, FAT_MAX_ROOT_ENTRIES);
+}
+
 void fat_data_block(uint8_t* dest, unsigned cluster, unsigned index)
 {
+    profile_block(FAT_DATA_START + (cluster - 2) * FAT_CLUSTER_SIZE + index);
+
+    if (in_subdir && cluster >= fat_chain_first && cluster <= fat_chain_last) {
+        unsigned sector = (cluster - fat_chain_first) * FAT_CLUSTER_SIZE + index;
+        unsigned first = sector * FAT_DENTRY_PER_SECTOR;
+
+        // Same triggers as the root directory: 0x02 until the last sector
+        sdemu_trigger_write((sdemu_trigger_read() & ~0x08) |
+            (sector == GUESS_SUBDIR_SECTORS - 1 ? 0x08 : 0x02));
+
+        for (unsigned i = 0; i < FAT_DENTRY_PER_SECTOR; i++) {
+            uint8_t *dentry = dest + i * FAT_DENTRY_SIZE;
+            if (first + i == 0) {
+                fat_dot_entry(dentry, ".", GUESS_SUBDIR_CLUSTER);
+            } else if (first + i == 1) {
+                fat_dot_entry(dentry, "..", 0);
+            } else {
+                guess_slot(dentry, first + i);
+            }
+            experiment_entry(first + i, GUESS_SUBDIR_ENTRIES);
+        }
+        return;
+    }
+
     memset(dest, 'Z', BLOCK_SIZE); 
     sprintf((char*) dest, "%04x+%x cluster\n", cluster, index);
 }
@@ -4,32 +4,163 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "ring.h"
+#include "candidate.h"
+
 // Power of two
 #define QUEUE_SIZE 128
 
+// A guess is a group of directory entries repeated through each sector:
+// a plain short entry, or LFN entries followed by their short entry. Groups
+// are padded in front with deleted entries to a power of two, so every
+// sector holds whole copies.
+#define GUESS_MAX_DENTRIES 4
+#define GUESS_LFN_MAX_CHARS ((GUESS_MAX_DENTRIES - 1) * FAT_LFN_CHARS)
+
 typedef struct {
-    uint8_t guess[FAT_DENTRY_SIZE];
+    uint8_t guess[FAT_DENTRY_SIZE * GUESS_MAX_DENTRIES];
+    uint32_t num_slots;         // Entries used in 'guess'; the short entry is last
+    uint32_t kind;              // GUESS_NORMAL or a control
     uint32_t measurement;
     uint32_t replicate_count;
 } queue_entry;
 
-// Uniquely track each experiment. Actual queue position is modulo QUEUE_SIZE
+// Control experiments. Every GUESS_CONTROL_PERIOD guesses, a copy of the
+// last one is sent again in a form the victim should skip without comparing
+// names, alternating between the kinds below. Their timing against normal
+// guesses tracks drift in the channel, which moves the normal-measurement
+// window, and shows whether the channel still separates fast from slow.
+//
+// An end-of-directory marker would be the fastest control of all, but the
+// victim stops reading there, so the sector after it is never timed.
+#define GUESS_NORMAL            0
+#define GUESS_CONTROL_DELETED   1       // 0xE5 in every entry
+#define GUESS_CONTROL_LABEL     2       // Attribute 0x08 on the short entry
+#define GUESS_CONTROL_KINDS     2
+
+#define GUESS_CONTROL_PERIOD        32
+#define GUESS_CONTROL_CALIBRATION   16      // Results averaged for a reference
+#define GUESS_CONTROL_MIN_SEPARATION 64     // Cycles; less and a kind isn't used
+#define GUESS_CONTROL_WARN_PERCENT  50
+
+typedef struct {
+    uint32_t results;
+    uint32_t missed;            // Skipped measurements
+    uint64_t calibration_sum;
+    int32_t reference;          // Mean of the first results
+    int32_t separation;         // Normal level minus reference, at calibration
+    int32_t ewma;               // Recent level, weight 1/16
+} control_stats_t;
+
+// Optionally the experiment runs in a subdirectory instead of the root,
+// listed there as its only entry. Its clusters are generated on demand.
+#define GUESS_SUBDIR_CLUSTER    0x40
+#define GUESS_SUBDIR_CLUSTERS   ((0x20 + FAT_CLUSTER_SIZE - 1) / FAT_CLUSTER_SIZE)
+#define GUESS_SUBDIR_SECTORS    (GUESS_SUBDIR_CLUSTERS * FAT_CLUSTER_SIZE)
+#define GUESS_SUBDIR_ENTRIES    (GUESS_SUBDIR_SECTORS * FAT_DENTRY_PER_SECTOR)
+
+// Running totals over normal measurements
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} baseline_t;
+
+// Most deviant unusual results seen so far
+#define OUTLIER_POOL_SIZE 64
+
+// Guesses go to the ISR through one ring and come back with their
+// measurements through another. The ISR works from private copies of the
+// guess it's presenting and the one it's timing.
+RING_DEFINE(guess_ring, queue_entry, QUEUE_SIZE)
+
+// Uniquely track each experiment. Both counters belong to the main loop;
+// the difference is the number in flight, never more than QUEUE_SIZE - 1.
 typedef uint64_t qptr_t;
 
-extern queue_entry queue[QUEUE_SIZE];
-extern volatile qptr_t qptr_write_guess;         // Advance when a guess is enqueued
-extern volatile qptr_t qptr_read_guess;          // Follows when guess is sent
-extern volatile qptr_t qptr_write_measurement;   // Follows when timestamp result is measured
-extern volatile qptr_t qptr_read_measurement;    // Follows when result is dequeued
+extern qptr_t qptr_write_guess;         // Advance when a guess is enqueued
+extern qptr_t qptr_read_measurement;    // Follows when result is dequeued
+
+extern uint32_t reset_counter;
+extern baseline_t baseline;
+extern control_stats_t control_stats[GUESS_CONTROL_KINDS];
+extern queue_entry outliers[OUTLIER_POOL_SIZE];
+extern uint32_t num_outliers;
+
+// Every normal guess with a measurement, packed with its statistics and
+// marked if it was ever unusual. Empty until guesser_track_candidates()
+// gives it room; not part of a checkpoint.
+extern candset_t guess_candidates;
+
+// Slots never written hold zeroes, and read as one empty entry
+static inline unsigned guess_slots(const queue_entry *entry) {
+    return entry->num_slots ? entry->num_slots : 1;
+}
 
-static inline queue_entry* qentry(qptr_t i) {
-    return &queue[i % QUEUE_SIZE];
+static inline const uint8_t* guess_short_entry(const queue_entry *entry) {
+    return entry->guess + (guess_slots(entry) - 1) * FAT_DENTRY_SIZE;
 }
 
 void reset_pulse(void);
 void mainloop_poll(void);
 
 void guess_dentry(const uint8_t *dentry);
+void guess_dentries(const uint8_t *dentries, unsigned count);
 void guess_filename(const char *name, const char *ext);
+void guess_long_filename(const char *long_name, const char *name, const char *ext);
+void guess_entry(const queue_entry *entry);
+void guess_packed(cand_name_t name);
+
+// "[NAME    .EXT]", followed by " {long name}" if the guess has one
+int guess_format(char *buf, int size, const queue_entry *entry);
+#define GUESS_FORMAT_LEN (16 + GUESS_LFN_MAX_CHARS + 3)
+
+// Move the experiment into a subdirectory, or keep it in the root with a
+// null name. Call once before the first guess, either way.
+void guesser_set_subdir(const char *name, const char *ext);
+
+// One guess per scan instead of one per sector, in the root directory.
+// Where the gateware can, the sdemu core serves those scans from a template
+// and the CPU only changes it between them. Call before the first guess.
+void guesser_set_per_scan(bool enable);
+
+// Have the gateware reset the victim as soon as it has read the last sector
+// of the experiment, rather than the main loop. Call after
+// guesser_set_subdir() and the first reset_pulse(); false if it can't.
+bool guesser_set_auto_reset(bool enable);
+
+// Measure to the victim's first edge on edgecap 'pins' after each block,
+// not to its next read, and learn the normal window from the first normal
+// results. Call before the first guess; false without the edgecap core.
+bool guesser_set_edge_timing(uint32_t pins);
+
+// Print every result as it's dequeued, for host/resultrank
+void guesser_log_results(bool enable);
+
+// Room for 'max' candidates in guess_candidates; false if SDRAM is short
+bool guesser_track_candidates(uint32_t max);
+
+// Guesses enqueued but without a dequeued result yet; returns the count
+uint32_t guesser_pending(queue_entry *dest);
+
+// Start numbering experiments at 'done', before any guesses are enqueued
+void guesser_restore(qptr_t done);
+
+// Current separation between controls and normal guesses, as a percentage of
+// the calibrated one; -1 until a control kind has calibrated
+int guesser_channel_health(void);
+
+// How far the controls have moved since calibration, in cycles. Added to
+// the normal-measurement window.
+int32_t guesser_drift(void);
+
+// Measurements in here are usual, drift included
+void guesser_normal_window(uint32_t *low, uint32_t *high);
+
+// Callbacks
+// Every dequeued guess result, usual or not; measurement is zero if it was
+// skipped. Control experiments aren't reported.
+void guess_result(const queue_entry *entry);
 
 #endif // _GUESSER_H
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <irq.h>
 #include <uart.h>
@@ -13,6 +14,69 @@
 #include "fat.h"
 #include "sdtimer.h"
 #include "guesser.h"
+#include "checkpoint.h"
+#include "mask.h"
+#include "profile.h"
+#include "hot.h"
+#include "sdclock.h"
+
+// Build options for what to enumerate; see mask.h for the syntax:
+//   -DWORDLIST_MASK='"?u?u?d?d.TXT,"'
+//   -DWORDLIST_MASK_MIN=N         shortest name to try, default 1
+//   -DWORDLIST_TRACK=N            keep statistics for up to N names in SDRAM
+#ifndef WORDLIST_MASK
+#define WORDLIST_MASK       "?a?a?a?a"
+#endif
+#ifndef WORDLIST_MASK_MIN
+#define WORDLIST_MASK_MIN   1
+#endif
+#ifndef WORDLIST_TRACK
+#define WORDLIST_TRACK      (128 * 1024)
+#endif
+
+// Build options for victims that look elsewhere:
+//   -DWORDLIST_SUBDIR='"NAME"'    run the experiment inside subdirectory NAME
+//   -DWORDLIST_LONG_NAMES=N       also give each guess an N character long
+//                                 name, its short name repeated
+//   -DWORDLIST_PER_SCAN           one guess per root directory scan, served
+//                                 by the sdemu synthesizer if it's there
+//   -DWORDLIST_PROFILE            print a timing profile of every scan, see
+//                                 profile.h
+//   -DWORDLIST_RESULTS            print every result, for host/resultrank
+//   -DWORDLIST_EDGE_PIN=N         time the victim to its next edge on edgecap
+//                                 input N, not to its next block read
+//   -DWORDLIST_BENCHMARK=N        time N cold and warm SD interrupt dispatches
+//                                 and MBR reads at startup, to compare builds
+//                                 with and without HOT_SRAM
+
+_Static_assert(sizeof(mask_state_t) <= CKPT_ENUM_SIZE, "mask position doesn't fit a checkpoint");
+
+static mask_t mask;
+static mask_state_t enumerator;
+
+// A checkpoint of another mask's run has nothing worth keeping, not even
+// its pending guesses or outliers
+static bool same_mask(const void *enum_state)
+{
+    mask_state_t saved;
+
+    memcpy(&saved, enum_state, sizeof saved);
+    return saved.hash == mask.hash;
+}
+
+// Every tracked name that was ever unusual, with its statistics
+static void print_outliers(void)
+{
+    printf("%u names tracked; unusual ones:\n", (unsigned) guess_candidates.count);
+    for (uint32_t i = 0; i < candset_slots(&guess_candidates); i++) {
+        candidate_t *c = candset_slot(&guess_candidates, i);
+        if (c && (c->flags & CAND_OUTLIER)) {
+            uint8_t name[CAND_NAME_LEN];
+            cand_unpack(name, c->name);
+            printf("  [%.8s.%.3s] mean %u over %u\n", name, name + 8, (unsigned) cand_mean(c), c->count);
+        }
+    }
+}
 
 int main(void)
 {
@@ -20,19 +84,82 @@ int main(void)
     irq_setie(1);
     time_init();
     uart_init();
+    blockmap_init(&fat_overlay, FAT_OVERLAY_BLOCKS);
     sdemu_init();
+    sdclock_init();
 
     puts("Wordlist experiment built "__DATE__" "__TIME__"\n");
 
+#ifdef WORDLIST_BENCHMARK
+    hot_benchmark(0, WORDLIST_BENCHMARK);
+#endif
+
+#ifdef WORDLIST_SUBDIR
+    guesser_set_subdir(WORDLIST_SUBDIR, "");
+#else
+    guesser_set_subdir(0, 0);
+#endif
+#ifdef WORDLIST_PER_SCAN
+    guesser_set_per_scan(true);
+#endif
+#ifdef WORDLIST_PROFILE
+    profile_enable(true);
+#endif
+#ifdef WORDLIST_RESULTS
+    guesser_log_results(true);
+#endif
+#ifdef WORDLIST_EDGE_PIN
+    if (!guesser_set_edge_timing(1 << WORDLIST_EDGE_PIN)) {
+        puts("No edge capture, timing block reads instead");
+    }
+#endif
+
+    if (!guesser_track_candidates(WORDLIST_TRACK)) {
+        puts("No room to track candidates");
+    }
+
+    // Tables never change during the run, the chain is set up above
+    if (fat_synth_tables(true)) {
+        puts("FAT tables generated in hardware");
+    }
+
+    if (!mask_parse(&mask, WORDLIST_MASK, WORDLIST_MASK_MIN)) {
+        return 1;
+    }
+    mask_start(&mask, &enumerator);
+    printf("Mask %s: %llu candidates\n", WORDLIST_MASK, (unsigned long long) mask_total(&mask));
+
     reset_pulse();
+    if (guesser_set_auto_reset(true)) {
+        puts("Victim reset sequenced in hardware");
+    }
+    checkpoint_restore(&enumerator, sizeof enumerator, same_mask);
+
+    char name[9], ext[4];
+    while (mask_next(&mask, &enumerator, name, ext)) {
+#ifdef WORDLIST_LONG_NAMES
+        unsigned len = strlen(name);
+        char long_name[WORDLIST_LONG_NAMES + 1];
+        for (int i = 0; i < WORDLIST_LONG_NAMES; i++) {
+            long_name[i] = name[i % len];
+        }
+        long_name[WORDLIST_LONG_NAMES] = '\0';
+        guess_long_filename(long_name, name, ext);
+#else
+        guess_filename(name, ext);
+#endif
+        checkpoint_poll(&enumerator, sizeof enumerator);
+    }
 
-    for (char p3 = ' '; p3 <= '`'; p3++) {
-    for (char p2 = ' '; p2 <= '`'; p2++) {
-    for (char p1 = ' '; p1 <= '`'; p1++) {
-    for (char p0 = ' '; p0 <= '`'; p0++) {
-        char guess[11] = {p0, p1, p2, p3, p0, p1, p2, p3, p0, p1, p2};
-        guess_filename(guess, guess+8);
-    }}}}
+    // Final state, so a restart doesn't repeat the run
+    checkpoint_save(&enumerator, sizeof enumerator);
+    profile_emit(true);
+    print_outliers();
 
     return 0;
 }
+
+void guess_result(const queue_entry *entry)
+{
+    // Outliers are already reported by the guesser
+}
@@ -0,0 +1,214 @@
+// Enumerate legal 8.3 names from a mask, one at a time
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <crc.h>
+
+#include "mask.h"
+
+static const char mask_symbols[] = "!#$%&'()-@^_`{}~";
+
+
+static char mask_upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+// Space only ever pads a short name, so it's never a candidate character
+static bool mask_legal(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+        (c && strchr(mask_symbols, c));
+}
+
+static bool mask_add(char *set, uint8_t *size, char c)
+{
+    c = mask_upper(c);
+    if (!mask_legal(c)) {
+        printf("Mask: '%c' can't be in a short name\n", c);
+        return false;
+    }
+    if (!strchr(set, c)) {
+        if (*size == MASK_MAX_SET) {
+            printf("Mask: more than %d characters in one position\n", MASK_MAX_SET);
+            return false;
+        }
+        set[(*size)++] = c;
+        set[*size] = '\0';
+    }
+    return true;
+}
+
+// Ranges pass over what short names can't hold, so [!-~] is all of them
+static bool mask_add_range(char *set, uint8_t *size, char first, char last)
+{
+    for (char c = first; c <= last; c++) {
+        if (mask_legal(mask_upper(c)) && !mask_add(set, size, c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool mask_add_class(char *set, uint8_t *size, char cls)
+{
+    switch (cls) {
+        case 'a':
+            return mask_add_class(set, size, 'u') &&
+                mask_add_class(set, size, 'd') &&
+                mask_add_class(set, size, 's');
+        case 'u':
+            return mask_add_range(set, size, 'A', 'Z');
+        case 'd':
+            return mask_add_range(set, size, '0', '9');
+        case 'h':
+            return mask_add_range(set, size, '0', '9') &&
+                mask_add_range(set, size, 'A', 'F');
+        case 's':
+            for (const char *c = mask_symbols; *c; c++) {
+                if (!mask_add(set, size, *c)) {
+                    return false;
+                }
+            }
+            return true;
+        default:
+            printf("Mask: unknown class '?%c'\n", cls);
+            return false;
+    }
+}
+
+// One position's token, returning what follows it or 0 on error
+static const char *mask_position(const char *spec, char *set, uint8_t *size)
+{
+    if (spec[0] == '?') {
+        return mask_add_class(set, size, spec[1]) ? spec + 2 : 0;
+    }
+
+    if (spec[0] == '[') {
+        spec++;
+        while (*spec && *spec != ']') {
+            bool ok;
+            if (spec[1] == '-' && spec[2] && spec[2] != ']') {
+                ok = mask_add_range(set, size, spec[0], spec[2]);
+                spec += 3;
+            } else {
+                ok = mask_add(set, size, *spec++);
+            }
+            if (!ok) {
+                return 0;
+            }
+        }
+        if (*spec != ']' || *size == 0) {
+            printf("Mask: unfinished or empty [set]\n");
+            return 0;
+        }
+        return spec + 1;
+    }
+
+    return mask_add(set, size, spec[0]) ? spec + 1 : 0;
+}
+
+bool mask_parse(mask_t *mask, const char *spec, unsigned min_len)
+{
+    const char *p = spec;
+
+    memset(mask, 0, sizeof *mask);
+
+    while (*p && *p != '.') {
+        if (mask->len == MASK_MAX_LEN) {
+            printf("Mask: name longer than %d\n", MASK_MAX_LEN);
+            return false;
+        }
+        p = mask_position(p, mask->set[mask->len], &mask->set_size[mask->len]);
+        if (!p) {
+            return false;
+        }
+        mask->len++;
+    }
+
+    if (mask->len == 0 || min_len < 1 || min_len > mask->len) {
+        printf("Mask: needs names of 1 to %d characters, from at least %u\n",
+            MASK_MAX_LEN, min_len);
+        return false;
+    }
+    mask->min_len = min_len;
+
+    // Extensions; a trailing comma or no '.' at all gives an empty one
+    do {
+        char *ext;
+        unsigned len = 0;
+
+        if (*p) {
+            p++;
+        }
+        if (mask->num_exts == MASK_MAX_EXTS) {
+            printf("Mask: more than %d extensions\n", MASK_MAX_EXTS);
+            return false;
+        }
+        ext = mask->ext[mask->num_exts++];
+        for (; *p && *p != ','; p++) {
+            char c = mask_upper(*p);
+            if (len == 3 || !mask_legal(c)) {
+                printf("Mask: bad extension\n");
+                return false;
+            }
+            ext[len++] = c;
+        }
+    } while (*p);
+
+    mask->hash = crc32((const unsigned char *) spec, strlen(spec)) ^ min_len;
+    return true;
+}
+
+uint64_t mask_total(const mask_t *mask)
+{
+    uint64_t total = 0, names = 1;
+
+    for (unsigned len = 1; len <= mask->len; len++) {
+        names *= mask->set_size[len - 1];
+        if (len >= mask->min_len) {
+            total += names;
+        }
+    }
+    return total * mask->num_exts;
+}
+
+void mask_start(const mask_t *mask, mask_state_t *state)
+{
+    memset(state, 0, sizeof *state);
+    state->hash = mask->hash;
+    state->len = mask->min_len;
+}
+
+bool mask_next(const mask_t *mask, mask_state_t *state, char *name, char *ext)
+{
+    int i;
+
+    if (state->len > mask->len) {
+        return false;
+    }
+
+    for (i = 0; i < state->len; i++) {
+        name[i] = mask->set[i][state->digit[i]];
+    }
+    name[i] = '\0';
+    strcpy(ext, mask->ext[state->ext]);
+    state->count++;
+
+    // Advance: extension fastest, then the last character of the name
+    if (++state->ext < mask->num_exts) {
+        return true;
+    }
+    state->ext = 0;
+    for (i = state->len - 1; i >= 0; i--) {
+        if (++state->digit[i] < mask->set_size[i]) {
+            return true;
+        }
+        state->digit[i] = 0;
+    }
+    state->len++;
+    return true;
+}
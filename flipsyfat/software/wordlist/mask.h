@@ -0,0 +1,63 @@
+// Enumerate legal 8.3 names from a mask, one at a time
+
+#ifndef _MASK_H
+#define _MASK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A mask is one token per name position, then optionally '.' and a comma
+// separated list of literal extensions, an empty one meaning none:
+//
+//   ?u  A-Z         ?d  0-9         ?h  0-9 A-F
+//   ?s  the symbols FAT allows in short names: !#$%&'()-@^_`{}~
+//   ?a  all of ?u ?d ?s
+//   [..] a set of its own, with ranges: [AEIOU0-4_]
+//   anything else is a fixed character
+//
+// Lowercase letters mean their uppercase ones, like the victim's own name
+// lookup. Names from 'min_len' positions up to the whole mask are tried,
+// shortest first, each with every extension in turn:
+//
+//   "?u?u?u?d.TXT,BIN,"   with min_len 1
+//
+// Characters short names can't hold are refused when the mask is parsed,
+// so every candidate is one the victim could match.
+
+#define MASK_MAX_LEN    8
+#define MASK_MAX_SET    64
+#define MASK_MAX_EXTS   8
+
+typedef struct {
+    uint8_t len;
+    uint8_t min_len;
+    uint8_t num_exts;
+    uint8_t set_size[MASK_MAX_LEN];
+    char set[MASK_MAX_LEN][MASK_MAX_SET + 1];
+    char ext[MASK_MAX_EXTS][4];
+    uint32_t hash;          // Identifies the mask in saved positions
+} mask_t;
+
+// Position in the enumeration. Plain data of fixed size, so it can go
+// straight into a checkpoint.
+typedef struct {
+    uint64_t count;         // Candidates produced so far
+    uint32_t hash;          // Of the mask it belongs to
+    uint8_t len;            // Current name length; past the mask when done
+    uint8_t ext;
+    uint8_t digit[MASK_MAX_LEN];
+} mask_state_t;
+
+// Returns false, after printing why, if the mask can't be used
+bool mask_parse(mask_t *mask, const char *spec, unsigned min_len);
+
+// Number of candidates in the whole enumeration
+uint64_t mask_total(const mask_t *mask);
+
+void mask_start(const mask_t *mask, mask_state_t *state);
+
+// Next candidate as NUL-terminated strings, name[9] and ext[4];
+// false once they're all done
+bool mask_next(const mask_t *mask, mask_state_t *state, char *name, char *ext);
+
+#endif // _MASK_H
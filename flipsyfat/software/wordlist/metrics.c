@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <generated/csr.h>
+
+#include "isr.h"
+#include "fat.h"
+#include "guesser.h"
+#include "metrics.h"
+
+#define METRICS_OCC_BUCKETS 8
+
+metrics_t metrics;
+
+// sdtimer wraps in under a minute; these don't
+static uint64_t uptime_cycles;
+static uint64_t isr_cycles;
+static uint32_t last_now;
+static uint32_t last_isr;
+static uint32_t occupancy[METRICS_OCC_BUCKETS];
+static uint32_t uart_samples, uart_full;
+
+// At the last query, for the window
+static uint64_t window_start;
+static uint32_t window_results;
+
+
+// value / total with two decimals
+static void print_ratio(const char *key, uint64_t value, uint64_t total)
+{
+    uint64_t hundredths = total ? value * 100 / total : 0;
+    printf(" %s=%u.%02u", key, (unsigned) (hundredths / 100), (unsigned) (hundredths % 100));
+}
+
+static void print_percent(const char *key, uint64_t value, uint64_t total)
+{
+    print_ratio(key, value * 100, total);
+    printf("%%");
+}
+
+void metrics_print(void)
+{
+    uint64_t seconds = uptime_cycles / CONFIG_CLOCK_FREQUENCY;
+    uint64_t window = uptime_cycles - window_start;
+
+    printf("M up=%u guesses=%u", (unsigned) seconds, (unsigned) metrics.results);
+    print_ratio("gps", (uint64_t) metrics.results * CONFIG_CLOCK_FREQUENCY, uptime_cycles);
+    printf(" scans=%u scans_h=%u resets=%u resets_h=%u",
+        (unsigned) metrics.scans,
+        (unsigned) (seconds ? (uint64_t) metrics.scans * 3600 / seconds : 0),
+        (unsigned) reset_counter,
+        (unsigned) (seconds ? (uint64_t) reset_counter * 3600 / seconds : 0));
+    print_percent("rep", metrics.replicas, metrics.results);
+    printf(" skipped=%u occ=", (unsigned) metrics.skipped);
+    for (int i = 0; i < METRICS_OCC_BUCKETS; i++) {
+        printf(i ? ",%u" : "%u", (unsigned) occupancy[i]);
+    }
+    print_percent("isr", isr_cycles, uptime_cycles);
+    print_percent("txfull", uart_full, uart_samples);
+    printf(" win=%u", (unsigned) (window / CONFIG_CLOCK_FREQUENCY));
+    print_ratio("win_gps", (uint64_t) (metrics.results - window_results) * CONFIG_CLOCK_FREQUENCY,
+        window);
+    printf("\n");
+
+    window_start = uptime_cycles;
+    window_results = metrics.results;
+}
+
+void metrics_poll(uint32_t queue_fill)
+{
+    uint32_t now, isr;
+    uint32_t bucket = queue_fill * METRICS_OCC_BUCKETS / QUEUE_SIZE;
+
+    sdtimer_capture_write(0);
+    now = sdtimer_capture_ts_read();
+    isr = isr_busy_cycles;
+    uptime_cycles += now - last_now;
+    isr_cycles += isr - last_isr;
+    last_now = now;
+    last_isr = isr;
+
+    occupancy[bucket < METRICS_OCC_BUCKETS ? bucket : METRICS_OCC_BUCKETS - 1]++;
+
+#ifdef CSR_UART_TXFULL_ADDR
+    uart_samples++;
+    uart_full += uart_txfull_read();
+#endif
+}
+
+bool metrics_command(char ch)
+{
+    if (ch != '?') {
+        return false;
+    }
+    metrics_print();
+    return true;
+}
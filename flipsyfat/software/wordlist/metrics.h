@@ -0,0 +1,41 @@
+// Throughput counters for the experiment, and the query that reports them
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Always counting. A host polls by sending '?' and gets one line back,
+// every field key=value, rates as integers or with two decimals:
+//
+//   M up=<s> guesses=<n> gps=<x.xx> scans=<n> scans_h=<n> resets=<n>
+//     resets_h=<n> rep=<x.xx%> skipped=<n> occ=<8 counts> isr=<x.xx%>
+//     txfull=<x.xx%> win=<s> win_gps=<x.xx>
+//
+// (all on one line). Rates are since start-up; the win_ fields since the
+// query before. occ is how full the guess queue was at each main loop
+// pass, in eighths of QUEUE_SIZE from empty up. txfull is how often the
+// UART's transmit FIFO was full when sampled, i.e. output backing up.
+// isr is the share of time in the interrupt handler, from its entry: the
+// SD emulator's block callbacks, which are most of it, and the UART.
+
+typedef struct {
+    uint32_t results;           // Normal results dequeued, measured or not
+    uint32_t replicas;          // Retries queued for unusual results
+    uint32_t skipped;           // Results without a measurement
+    uint32_t scans;             // Reset cycles in which the victim read the directory
+} metrics_t;
+
+extern metrics_t metrics;
+
+// Main loop, often: samples and keeps the uptime
+void metrics_poll(uint32_t queue_fill);
+
+// Console input, one character: answers a query and returns true, or
+// returns false for the next handler
+bool metrics_command(char ch);
+
+void metrics_print(void);
+
+#endif // _METRICS_H
@@ -0,0 +1,105 @@
+// Timing profile of each directory scan, between two resets
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <generated/csr.h>
+
+#include "reset.h"
+#include "profile.h"
+
+uint32_t profile_dropped;
+
+static profile_ring_t profiles;        // ISR to main loop
+static profile_t record;                // ISR only
+static bool record_open;
+static uint32_t first_read_ts;
+static uint32_t last_read_ts;
+static volatile bool enabled;
+
+
+void profile_enable(bool enable)
+{
+    enabled = enable;
+}
+
+static void profile_close(void)
+{
+    if (record_open && !profile_ring_push(&profiles, &record)) {
+        profile_dropped++;
+    }
+    record_open = false;
+}
+
+void profile_sample(uint32_t lba, uint32_t reset, cand_name_t name)
+{
+    uint32_t read_ts, sector;
+
+    if (!enabled) {
+        return;
+    }
+
+    if (record_open && record.reset != reset) {
+        profile_close();
+    }
+
+    read_ts = sdtimer_read_ts_read();
+    sector = lba - FAT_ROOT_START;
+
+    if (sector < PROFILE_SECTORS) {
+        if (!record_open) {
+            memset(&record, 0, sizeof record);
+            record.reset = reset;
+            record.name = name;
+            record.first = read_ts - reset_timestamp();
+            record_open = true;
+            first_read_ts = read_ts;
+        }
+        if (!record.gap[sector]) {
+            // Never zero once seen
+            record.gap[sector] = (read_ts - sdtimer_done_ts_read()) | 1;
+            record.sectors++;
+        }
+        if (sector >= record.last) {
+            record.last = sector + 1;
+        }
+        record.span = read_ts - first_read_ts;
+        last_read_ts = read_ts;
+
+    } else if (record_open && lba >= FAT_DATA_START) {
+        if (!record.data_reads) {
+            record.data_lba = lba;
+            record.data_gap = read_ts - last_read_ts;
+        }
+        if (record.data_reads < 0xff) {
+            record.data_reads++;
+        }
+    }
+}
+
+uint32_t profile_emit(bool all)
+{
+    uint32_t count = profile_ring_count(&profiles);
+
+    if (!count || (!all && count < PROFILE_RING_SIZE / 2)) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const profile_t *p = profile_ring_peek(&profiles, i);
+
+        printf("P %x %llx %x %x %x %x %x %x %x ",
+            (unsigned) p->reset, (unsigned long long) p->name,
+            (unsigned) p->first, (unsigned) p->span,
+            p->last, p->sectors, p->data_reads,
+            (unsigned) p->data_lba, (unsigned) p->data_gap);
+        for (unsigned s = 0; s < PROFILE_SECTORS; s++) {
+            printf(s ? ",%x" : "%x", (unsigned) p->gap[s]);
+        }
+        printf("\n");
+    }
+    profile_ring_release(&profiles, count);
+    return count;
+}
@@ -0,0 +1,54 @@
+// Timing profile of each directory scan, between two resets
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fat.h"
+#include "ring.h"
+#include "candidate.h"
+
+// One record per reset cycle, holding every root directory read the CPU
+// heard about. Gaps are read_ts - done_ts, the time the victim spent on
+// the block before, with 0 for sectors not seen: ones it never read, and
+// ones the sdemu synthesizer served by itself. 'last' short of
+// PROFILE_SECTORS means the victim stopped early, which it does when a
+// name matches.
+
+#define PROFILE_SECTORS     (FAT_ROOT_SECTORS < 64 ? FAT_ROOT_SECTORS : 64)
+#define PROFILE_RING_SIZE   16
+
+typedef struct {
+    uint32_t reset;             // reset_counter during the scan
+    cand_name_t name;           // Per-scan guess, packed; 0 otherwise
+    uint32_t first;             // First root read, after the reset timestamp
+    uint32_t span;              // From the first root read to the last
+    uint32_t gap[PROFILE_SECTORS];
+    uint8_t sectors;            // Root sectors seen
+    uint8_t last;               // Highest one seen, plus one
+    uint8_t data_reads;         // Data blocks read after the directory, saturating
+    uint8_t pad;
+    uint32_t data_lba;          // First of those
+    uint32_t data_gap;          // Its read after the last root read
+} profile_t;
+
+RING_DEFINE(profile_ring, profile_t, PROFILE_RING_SIZE)
+
+// Records that didn't fit in the ring
+extern uint32_t profile_dropped;
+
+// Nothing is recorded until enabled
+void profile_enable(bool enable);
+
+// ISR: the victim is reading 'lba' during reset cycle 'reset'. A new cycle
+// closes the record of the one before.
+void profile_sample(uint32_t lba, uint32_t reset, cand_name_t name);
+
+// Main loop: print finished records in bulk, one line each, in hex:
+//   P reset name first span last sectors data_reads data_lba data_gap gap,gap,...
+// Waits for the ring to be half full unless 'all'. Returns how many.
+uint32_t profile_emit(bool all);
+
+#endif // _PROFILE_H
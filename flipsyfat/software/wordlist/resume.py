@@ -0,0 +1,39 @@
+#!/usr/bin/env python3
+"""Send the newest checkpoint from a wordlist log back to a freshly reset board.
+
+   Usage: resume.py serial-port baudrate logfile
+
+   Run it while the board is waiting at "Send RESUME <checkpoint>".
+   """
+
+import sys
+
+import serial
+
+
+def last_checkpoint(path):
+    found = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            start = line.find("CKPT ")
+            if start >= 0:
+                found = line[start + 5:].strip()
+    return found
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    port, baud, log = sys.argv[1:]
+
+    ckpt = last_checkpoint(log)
+    if not ckpt:
+        sys.exit("no CKPT line in " + log)
+
+    with serial.Serial(port, int(baud)) as s:
+        s.write(("RESUME " + ckpt + "\n").encode())
+    print("sent {} byte checkpoint".format(len(ckpt) // 2))
+
+
+if __name__ == "__main__":
+    main()
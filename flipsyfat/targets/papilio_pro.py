@@ -6,9 +6,12 @@ from migen import *
 from flipsyfat.cores.sd_emulator import SDEmulator
 from flipsyfat.cores.sd_trigger import SDTrigger
 from flipsyfat.cores.sd_timer import SDTimer
+from flipsyfat.cores.sd_clock import SDClockMonitor
+from flipsyfat.cores.edge_capture import EdgeCapture
 from flipsyfat.cores.clock import ClockOutput
+from flipsyfat.cores.gpio import GPIOTristate
+from flipsyfat.cores.reset_seq import ResetSequencer
 from misoc.targets.papilio_pro import BaseSoC
-from misoc.cores.gpio import GPIOTristate
 from migen.build.generic_platform import *
 from misoc.integration.soc_sdram import *
 from misoc.integration.builder import *
@@ -30,6 +33,10 @@ io = [
              "A:8 A:9 A:10 A:11 A:12 A:13 A:14 A:15"),
         IOStandard("LVCMOS33")
     ),
+    ("capture", 0,
+        Pins("B:0 B:1 B:2 B:3"),
+        IOStandard("LVCMOS33")
+    ),
     ("debug", 0,
         Pins("B:12 B:13 B:14 B:15"),
         IOStandard("LVCMOS33")
@@ -47,11 +54,13 @@ class Flipsyfat(BaseSoC):
     }
     mem_map.update(BaseSoC.mem_map)
 
-    def __init__(self, **kwargs):
+    def __init__(self, card_blocks=None, sector_synth=True, **kwargs):
         BaseSoC.__init__(self, uart_baudrate=500000, **kwargs)
         self.platform.add_extension(io)
 
-        self.submodules.sdemu = SDEmulator(self.platform, self.platform.request("sdemu"))
+        self.submodules.sdemu = SDEmulator(self.platform, self.platform.request("sdemu"),
+            card_blocks=card_blocks, synth=sector_synth)
+        self.config["SDEMU_CARD_BLOCKS"] = self.sdemu.ll.card_blocks
         self.register_mem("sdemu", self.mem_map["sdemu"], self.sdemu.bus, self.sdemu.mem_size)
         self.csr_devices += ["sdemu"]
         self.interrupt_devices += ["sdemu"]
@@ -59,7 +68,15 @@ class Flipsyfat(BaseSoC):
         self.submodules.sdtimer = SDTimer(self.sdemu.ll)
         self.csr_devices += ["sdtimer"]
 
-        self.submodules.sdtrig = SDTrigger(self.sdemu.ll, self.platform.request("trigger"))
+        self.submodules.sdclk = SDClockMonitor(self.sdemu.ll, self.sdtimer.cnt)
+        self.csr_devices += ["sdclk"]
+
+        # Victim signals, timestamped like the SD emulator's events
+        self.submodules.edgecap = EdgeCapture(self.platform.request("capture"), self.sdtimer.cnt)
+        self.csr_devices += ["edgecap"]
+
+        self.submodules.sdtrig = SDTrigger(self.sdemu.ll, self.platform.request("trigger"),
+            synth=self.sdemu.synth)
         self.csr_devices += ["sdtrig"]
 
         self.submodules.gpio = GPIOTristate(self.platform.request("gpio"))
@@ -68,6 +85,11 @@ class Flipsyfat(BaseSoC):
         self.submodules.clkout = ClockOutput(self.platform.request("clkout"))
         self.csr_devices += ["clkout"]
 
+        # Victim reset on gpio 0, with the clock stopped
+        self.submodules.resetseq = ResetSequencer(self.sdemu, self.gpio, self.clkout,
+            self.sdtimer.cnt, gpio_mask=1 << 0)
+        self.csr_devices += ["resetseq"]
+
         # Activity LED
         self.io_activity = self.sdemu.ll.block_read_act | self.sdemu.ll.block_write_act
         self.sync += self.platform.request("user_led").eq(self.io_activity)
@@ -84,9 +106,15 @@ def main():
     parser = argparse.ArgumentParser(description="Flipsyfat port to the Papilio Pro")
     builder_args(parser)
     soc_sdram_args(parser)
+    parser.add_argument("--card-blocks", type=lambda s: int(s, 0), default=None,
+                        help="emulated card size in 512-byte blocks, a multiple of 1024 "
+                             "(firmware FAT volumes must fit; see software/common/fat.h)")
+    parser.add_argument("--no-sector-synth", action="store_true",
+                        help="leave out the hardware root directory and FAT block generator")
     args = parser.parse_args()
 
-    soc = Flipsyfat(**soc_sdram_argdict(args))
+    soc = Flipsyfat(card_blocks=args.card_blocks, sector_synth=not args.no_sector_synth,
+        **soc_sdram_argdict(args))
     builder = Builder(soc, **builder_argdict(args))
     builder.build()
 